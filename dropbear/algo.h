@@ -88,6 +88,11 @@ struct dropbear_hash {
 	/* hashsize may be truncated from the size returned by hash_desc,
 	   eg sha1-96 */
 	const unsigned char hashsize;
+	/* encrypt-then-MAC (*-etm@openssh.com): the packet length is sent in
+	   the clear and the MAC covers the ciphertext */
+	const unsigned char etm;
+	/* UMAC rather than HMAC, hash_desc is NULL */
+	const unsigned char umac;
 };
 
 enum dropbear_kex_mode {
@@ -0,0 +1,170 @@
+#include "includes.h"
+#include "bench.h"
+#include "dbutil.h"
+#include "buffer.h"
+#include "bignum.h"
+#include "ecc.h"
+#include "ecdsa.h"
+#include "crypto_desc.h"
+#include "dbrandom.h"
+
+/* ECDH and ECDSA on each NIST curve, with ltm_desc's point multiplication
+ * hooks pointing at the specialised P-256/P-384 code in ltc_ecc_nistp.c
+ * and at libtomcrypt's generic ltc_ecc_mulmod()/ltc_ecc_mul2add(). P-521
+ * always takes the generic path, so it shows the noise between the two.
+ * A server handshake with ecdh-sha2-nistp* and an ECDSA hostkey makes an
+ * ephemeral key, the shared secret and a signature. */
+
+#if DROPBEAR_ECDSA && DROPBEAR_ECDH
+
+struct ecc_bench {
+	const struct dropbear_ecc_curve *curve;
+	ecc_key *hostkey; /* ECDSA */
+	ecc_key *peer; /* the client's ephemeral ECDH key */
+	buffer *data; /* stands in for the exchange hash */
+	buffer *sig;
+	unsigned int sig_pos; /* of the signature blob in sig */
+};
+
+static ecc_key *make_key(const struct dropbear_ecc_curve *curve) {
+	ecc_key *key = m_malloc(sizeof(*key));
+	if (ecc_make_key_ex(NULL, dropbear_ltc_prng, key,
+				curve->dp) != CRYPT_OK) {
+		dropbear_exit("ECC error");
+	}
+	return key;
+}
+
+static void free_key(ecc_key *key) {
+	ecc_free(key);
+	m_free(key);
+}
+
+static void bench_keygen(void *arg) {
+	struct ecc_bench *b = arg;
+	free_key(make_key(b->curve));
+}
+
+static void bench_ecdh(void *arg) {
+	struct ecc_bench *b = arg;
+	ecc_key *key = make_key(b->curve);
+	mp_int *secret = dropbear_ecc_shared_secret(b->peer, key);
+	mp_clear(secret);
+	m_free(secret);
+	free_key(key);
+}
+
+static void bench_sign(void *arg) {
+	struct ecc_bench *b = arg;
+	buffer *sig = buf_new(300);
+	buf_put_ecdsa_sign(sig, b->hostkey, b->data);
+	buf_free(sig);
+}
+
+static void bench_verify(void *arg) {
+	struct ecc_bench *b = arg;
+	buf_setpos(b->sig, b->sig_pos);
+	if (buf_ecdsa_verify(b->sig, b->hostkey, b->data) != DROPBEAR_SUCCESS) {
+		dropbear_exit("ECDSA verify failed");
+	}
+}
+
+static void bench_handshake(void *arg) {
+	bench_ecdh(arg);
+	bench_sign(arg);
+}
+
+/* point multiplication through ltc_ecc_nistp.c or the generic code */
+static void use_nistp(int on) {
+#ifdef LTC_ECC_NISTP
+	ltc_mp.ecc_ptmul = on ? ltc_ecc_nistp_mulmod : ltc_ecc_mulmod;
+	ltc_mp.ecc_mul2add = on ? ltc_ecc_nistp_mul2add : ltc_ecc_mul2add;
+#else
+	(void)on;
+#endif
+}
+
+/* both paths have to agree on the shared secret */
+static void check_paths(struct ecc_bench *b) {
+	mp_int *s1, *s2;
+
+	use_nistp(1);
+	s1 = dropbear_ecc_shared_secret(b->peer, b->hostkey);
+	use_nistp(0);
+	s2 = dropbear_ecc_shared_secret(b->peer, b->hostkey);
+	if (mp_cmp(s1, s2) != MP_EQ) {
+		dropbear_exit("%s shared secrets differ", b->curve->name);
+	}
+	mp_clear(s1);
+	mp_clear(s2);
+	m_free(s1);
+	m_free(s2);
+}
+
+static void run_curve(struct ecc_bench *b, const char *path) {
+	static const struct {
+		const char *name;
+		void (*fn)(void *arg);
+	} ops[] = {
+		{"keygen", bench_keygen},
+		{"ecdh", bench_ecdh},
+		{"ecdsa sign", bench_sign},
+		{"ecdsa verify", bench_verify},
+		{"server handshake", bench_handshake},
+	};
+	char name[100];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		snprintf(name, sizeof(name), "%s %s %s", b->curve->name,
+				ops[i].name, path);
+		bench_print(name, bench_time(ops[i].fn, b));
+	}
+}
+
+int main(int argc, char ** argv) {
+	struct ecc_bench b;
+	unsigned int i;
+
+	bench_setup(argc, argv);
+
+	for (i = 0; dropbear_ecc_curves[i] != NULL; i++) {
+		b.curve = dropbear_ecc_curves[i];
+		b.hostkey = make_key(b.curve);
+		b.peer = make_key(b.curve);
+		b.data = buf_new(32);
+		genrandom(buf_getwriteptr(b.data, 32), 32);
+		buf_incrwritepos(b.data, 32);
+
+		b.sig = buf_new(300);
+		buf_put_ecdsa_sign(b.sig, b.hostkey, b.data);
+		buf_setpos(b.sig, 0);
+		buf_eatstring(b.sig);
+		b.sig_pos = b.sig->pos;
+
+		check_paths(&b);
+#ifdef LTC_ECC_NISTP
+		use_nistp(1);
+		run_curve(&b, "nistp");
+#endif
+		use_nistp(0);
+		run_curve(&b, "generic");
+		use_nistp(1);
+
+		buf_free(b.sig);
+		buf_free(b.data);
+		free_key(b.peer);
+		free_key(b.hostkey);
+	}
+	return 0;
+}
+
+#else
+
+int main(int argc, char ** argv) {
+	bench_setup(argc, argv);
+	printf("Built without ECDSA or ECDH\n");
+	return 0;
+}
+
+#endif /* DROPBEAR_ECDSA && DROPBEAR_ECDH */
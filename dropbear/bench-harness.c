@@ -0,0 +1,77 @@
+#include "includes.h"
+#include "bench.h"
+#include "dbutil.h"
+#include "dbrandom.h"
+#include "crypto_desc.h"
+
+static unsigned int bench_msec = BENCH_DEFAULT_MSEC;
+
+void bench_setup(int argc, char ** argv) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+#if DEBUG_TRACE
+		if (strcmp(argv[i], "-v") == 0) {
+			debug_trace = 1;
+			TRACE(("debug printing on"))
+			continue;
+		}
+#endif
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			i++;
+			if (m_str_to_uint(argv[i], &bench_msec) == DROPBEAR_FAILURE
+					|| bench_msec == 0) {
+				dropbear_exit("Bad time '%s'", argv[i]);
+			}
+			continue;
+		}
+		fprintf(stderr, "Usage: %s [-t msec per measurement]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	crypto_init();
+	seedrandom();
+	setlinebuf(stdout);
+}
+
+static double now_usec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double time_calls(void (*fn)(void *arg), void *arg, unsigned long n) {
+	unsigned long i;
+	double start = now_usec();
+	for (i = 0; i < n; i++) {
+		fn(arg);
+	}
+	return now_usec() - start;
+}
+
+double bench_time(void (*fn)(void *arg), void *arg) {
+	double round_usec = bench_msec * 1e3 / BENCH_ROUNDS;
+	double t, best;
+	unsigned long n = 1;
+	int r;
+
+	/* find a number of calls that fills a round, which also warms up */
+	while ((t = time_calls(fn, arg, n)) < round_usec) {
+		if (t < round_usec / 8) {
+			n *= 8;
+		} else {
+			n = n * round_usec / t + 1;
+		}
+	}
+	best = t / n;
+
+	for (r = 1; r < BENCH_ROUNDS; r++) {
+		t = time_calls(fn, arg, n) / n;
+		best = MIN(best, t);
+	}
+	return best;
+}
+
+void bench_print(const char *name, double usec) {
+	printf("%-40s %12.2f us %12.1f /s\n", name, usec, 1e6 / usec);
+}
@@ -0,0 +1,322 @@
+/* Karatsuba and Toom-Cook are mostly left out of dropbear by
+ * tommath_class.h. Those left out are built into this benchmark from the
+ * libtommath sources so that mp_mul() and mp_sqr() as configured can be
+ * compared with one level of each, their recursion goes through mp_mul()
+ * and mp_sqr(). */
+#include "tommath_private.h"
+#ifndef BN_S_MP_KARATSUBA_MUL_C
+#define BN_S_MP_KARATSUBA_MUL_C
+#include "bn_s_mp_karatsuba_mul.c"
+#endif
+#ifndef BN_S_MP_KARATSUBA_SQR_C
+#define BN_S_MP_KARATSUBA_SQR_C
+#include "bn_s_mp_karatsuba_sqr.c"
+#endif
+#ifndef BN_S_MP_TOOM_MUL_C
+#define BN_S_MP_TOOM_MUL_C
+#include "bn_s_mp_toom_mul.c"
+#endif
+#ifndef BN_S_MP_TOOM_SQR_C
+#define BN_S_MP_TOOM_SQR_C
+#include "bn_s_mp_toom_sqr.c"
+#endif
+
+#include "includes.h"
+#include "bench.h"
+#include "dbutil.h"
+#include "buffer.h"
+#include "bignum.h"
+#include "dbrandom.h"
+#include "crypto_desc.h"
+#include "dh_groups.h"
+#include "signkey.h"
+#include "rsa.h"
+#include "genrsa.h"
+
+/* Timings of the bignum operations dropbear relies on, to catch
+ * regressions and to choose the libtommath cutoffs:
+ * - mp_mul and mp_sqr by size, as configured against one level of
+ *   Karatsuba and Toom-Cook, and the size from which each of those wins.
+ *   Run it with both digit sizes, the 32 bit ABIs have 28 bit digits
+ * - mp_exptmod at 1024, 2048 and 4096 bits
+ * - RSA 2048 sign and verify
+ * - DH g^x with and without the fixed-base table, and the shared secret
+ * ECDH and ECDSA are in bench-ecc */
+
+typedef mp_err (*mul_fn)(const mp_int *a, const mp_int *b, mp_int *c);
+typedef mp_err (*sqr_fn)(const mp_int *a, mp_int *b);
+
+static const struct {
+	const char *name;
+	mul_fn mul;
+	sqr_fn sqr;
+} mul_algos[] = {
+	{"default", mp_mul, mp_sqr},
+	{"karatsuba", s_mp_karatsuba_mul, s_mp_karatsuba_sqr},
+	{"toom", s_mp_toom_mul, s_mp_toom_sqr},
+};
+#define NUM_MUL_ALGOS (sizeof(mul_algos) / sizeof(mul_algos[0]))
+
+/* operand sizes in bits, up to twice dropbear's largest. The number of
+ * digits depends on MP_DIGIT_BIT, and comba squaring only goes up to 127
+ * digits, MP_MAXFAST/2 - 1 */
+static const int mul_sizes[] = {512, 1024, 1536, 2048, 2560, 3072, 3584, 4096,
+	5120, 6144, 7168, 8192};
+#define NUM_MUL_SIZES (sizeof(mul_sizes) / sizeof(mul_sizes[0]))
+
+struct mp_bench {
+	mp_int a, b, c, m;
+	mul_fn mul;
+	sqr_fn sqr;
+};
+
+/* a random number of exactly bits bits */
+static void random_mp(mp_int *x, int bits) {
+	unsigned int len = (bits + 7) / 8;
+	unsigned char *bytes = m_malloc(len);
+	DEF_MP_INT(top);
+
+	genrandom(bytes, len);
+	bytes_to_mp(x, bytes, len);
+	m_free(bytes);
+
+	m_mp_init(&top);
+	if (mp_mod_2d(x, bits - 1, x) != MP_OKAY
+			|| mp_2expt(&top, bits - 1) != MP_OKAY
+			|| mp_add(x, &top, x) != MP_OKAY) {
+		dropbear_exit("bignum error");
+	}
+	mp_clear(&top);
+}
+
+static void bench_mul(void *arg) {
+	struct mp_bench *b = arg;
+	if (b->mul(&b->a, &b->b, &b->c) != MP_OKAY) {
+		dropbear_exit("bignum error");
+	}
+}
+
+static void bench_sqr(void *arg) {
+	struct mp_bench *b = arg;
+	if (b->sqr(&b->a, &b->c) != MP_OKAY) {
+		dropbear_exit("bignum error");
+	}
+}
+
+static void bench_exptmod(void *arg) {
+	struct mp_bench *b = arg;
+	if (mp_exptmod(&b->a, &b->b, &b->m, &b->c) != MP_OKAY) {
+		dropbear_exit("bignum error");
+	}
+}
+
+static int digits(int bits) {
+	return (bits + MP_DIGIT_BIT - 1) / MP_DIGIT_BIT;
+}
+
+/* Prints the smallest size from which algo is faster than mp_mul() or
+ * mp_sqr() as built at every larger size too, where its cutoff would be */
+static void print_cutoff(const char *op, unsigned int algo,
+		double usec[NUM_MUL_ALGOS][NUM_MUL_SIZES]) {
+	int from = -1;
+	int i;
+
+	for (i = NUM_MUL_SIZES - 1; i >= 0; i--) {
+		if (usec[algo][i] >= usec[0][i]) {
+			break;
+		}
+		from = mul_sizes[i];
+	}
+	if (from < 0) {
+		printf("%s %s: slower up to %d bits, %d digits\n",
+				mul_algos[algo].name, op, mul_sizes[NUM_MUL_SIZES-1],
+				digits(mul_sizes[NUM_MUL_SIZES-1]));
+	} else {
+		printf("%s %s: faster from %d bits, %d digits\n",
+				mul_algos[algo].name, op, from, digits(from));
+	}
+}
+
+static void run_mul(void) {
+	static double mul_usec[NUM_MUL_ALGOS][NUM_MUL_SIZES];
+	static double sqr_usec[NUM_MUL_ALGOS][NUM_MUL_SIZES];
+	struct mp_bench b;
+	char name[100];
+	unsigned int i, j;
+
+	m_mp_init_multi(&b.a, &b.b, &b.c, &b.m, NULL);
+	for (i = 0; i < NUM_MUL_SIZES; i++) {
+		random_mp(&b.a, mul_sizes[i]);
+		random_mp(&b.b, mul_sizes[i]);
+		for (j = 0; j < NUM_MUL_ALGOS; j++) {
+			b.mul = mul_algos[j].mul;
+			b.sqr = mul_algos[j].sqr;
+			mul_usec[j][i] = bench_time(bench_mul, &b);
+			snprintf(name, sizeof(name), "mp_mul %d bits %s",
+					mul_sizes[i], mul_algos[j].name);
+			bench_print(name, mul_usec[j][i]);
+		}
+		for (j = 0; j < NUM_MUL_ALGOS; j++) {
+			b.mul = mul_algos[j].mul;
+			b.sqr = mul_algos[j].sqr;
+			sqr_usec[j][i] = bench_time(bench_sqr, &b);
+			snprintf(name, sizeof(name), "mp_sqr %d bits %s",
+					mul_sizes[i], mul_algos[j].name);
+			bench_print(name, sqr_usec[j][i]);
+		}
+	}
+	mp_clear_multi(&b.a, &b.b, &b.c, &b.m, NULL);
+
+	printf("%d bit digits, 4096 bits is %d digits. "
+			"One level of each, compared with default:\n",
+			MP_DIGIT_BIT, digits(4096));
+	for (j = 1; j < NUM_MUL_ALGOS; j++) {
+		print_cutoff("mul", j, mul_usec);
+		print_cutoff("sqr", j, sqr_usec);
+	}
+}
+
+static void run_exptmod(void) {
+	static const int bits[] = {1024, 2048, 4096};
+	struct mp_bench b;
+	char name[100];
+	unsigned int i;
+
+	m_mp_init_multi(&b.a, &b.b, &b.c, &b.m, NULL);
+	for (i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+		/* odd modulus so that Montgomery reduction is used, as for
+		 * RSA and DH */
+		random_mp(&b.m, bits[i]);
+		if (MP_IS_EVEN(&b.m) && mp_add_d(&b.m, 1, &b.m) != MP_OKAY) {
+			dropbear_exit("bignum error");
+		}
+		random_mp(&b.a, bits[i] - 1);
+		random_mp(&b.b, bits[i]);
+		snprintf(name, sizeof(name), "mp_exptmod %d bits", bits[i]);
+		bench_print(name, bench_time(bench_exptmod, &b));
+	}
+	mp_clear_multi(&b.a, &b.b, &b.c, &b.m, NULL);
+}
+
+#if DROPBEAR_RSA
+struct rsa_bench {
+	dropbear_rsa_key *key;
+	buffer *data;
+	buffer *sig;
+};
+
+static void bench_rsa_sign(void *arg) {
+	struct rsa_bench *b = arg;
+	buf_setlen(b->sig, 0);
+	buf_setpos(b->sig, 0);
+	buf_put_rsa_sign(b->sig, b->key, DROPBEAR_SIGNATURE_RSA_SHA256, b->data);
+}
+
+#if DROPBEAR_SIGNKEY_VERIFY
+static void bench_rsa_verify(void *arg) {
+	struct rsa_bench *b = arg;
+	buf_setpos(b->sig, 0);
+	buf_eatstring(b->sig);
+	if (buf_rsa_verify(b->sig, b->key, DROPBEAR_SIGNATURE_RSA_SHA256,
+				b->data) != DROPBEAR_SUCCESS) {
+		dropbear_exit("RSA verify failed");
+	}
+}
+#endif
+
+static void run_rsa(void) {
+	struct rsa_bench b;
+	dropbear_rsa_key *gen;
+	buffer *keybuf;
+
+	/* read back as a hostkey is, which derives the CRT values */
+	gen = gen_rsa_priv_key(2048);
+	keybuf = buf_new(3000);
+	buf_put_rsa_priv_key(keybuf, gen);
+	buf_setpos(keybuf, 0);
+	b.key = m_malloc(sizeof(*b.key));
+	if (buf_get_rsa_priv_key(keybuf, b.key) != DROPBEAR_SUCCESS) {
+		dropbear_exit("RSA key error");
+	}
+	buf_burn(keybuf);
+	buf_free(keybuf);
+	rsa_key_free(gen);
+
+	b.data = buf_new(32);
+	genrandom(buf_getwriteptr(b.data, 32), 32);
+	buf_incrwritepos(b.data, 32);
+	b.sig = buf_new(600);
+
+	bench_print("rsa 2048 sign", bench_time(bench_rsa_sign, &b));
+#if DROPBEAR_SIGNKEY_VERIFY
+	bench_print("rsa 2048 verify", bench_time(bench_rsa_verify, &b));
+#endif
+
+	buf_free(b.sig);
+	buf_free(b.data);
+	rsa_key_free(b.key);
+}
+#endif /* DROPBEAR_RSA */
+
+#if DROPBEAR_NORMAL_DH
+struct dh_bench {
+	const unsigned char *p_bytes;
+	mp_int p, priv, pub, them, secret;
+};
+
+static void bench_dh_pub(void *arg) {
+	struct dh_bench *b = arg;
+	dh_pow_g(b->p_bytes, &b->p, &b->priv, &b->pub);
+}
+
+static void bench_dh_secret(void *arg) {
+	struct dh_bench *b = arg;
+	if (mp_exptmod(&b->them, &b->priv, &b->p, &b->secret) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+}
+
+static void run_dh_group(const char *group, const unsigned char *p_bytes,
+		unsigned int p_len) {
+	struct dh_bench b;
+	DEF_MP_INT(q);
+	char name[100];
+
+	b.p_bytes = p_bytes;
+	m_mp_init_multi(&b.p, &b.priv, &b.pub, &b.them, &b.secret, &q, NULL);
+	bytes_to_mp(&b.p, p_bytes, p_len);
+	/* 0 < priv < q = (p-1)/2, as make_kexdh_param() */
+	if (mp_sub_d(&b.p, 1, &q) != MP_OKAY || mp_div_2(&q, &q) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+	gen_random_mpint(&q, &b.priv);
+	gen_random_mpint(&q, &b.them);
+
+	snprintf(name, sizeof(name), "dh %s g^x", group);
+	bench_print(name, bench_time(bench_dh_pub, &b));
+	dh_prepare_base_table(p_bytes, &b.p);
+	snprintf(name, sizeof(name), "dh %s g^x table", group);
+	bench_print(name, bench_time(bench_dh_pub, &b));
+	snprintf(name, sizeof(name), "dh %s shared secret", group);
+	bench_print(name, bench_time(bench_dh_secret, &b));
+
+	mp_clear_multi(&b.p, &b.priv, &b.pub, &b.them, &b.secret, &q, NULL);
+}
+#endif /* DROPBEAR_NORMAL_DH */
+
+int main(int argc, char ** argv) {
+	bench_setup(argc, argv);
+
+	run_mul();
+	run_exptmod();
+#if DROPBEAR_RSA
+	run_rsa();
+#endif
+#if DROPBEAR_DH_GROUP14
+	run_dh_group("group14", dh_p_14, DH_P_14_LEN);
+#endif
+#if DROPBEAR_DH_GROUP16
+	run_dh_group("group16", dh_p_16, DH_P_16_LEN);
+#endif
+	return 0;
+}
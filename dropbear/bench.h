@@ -0,0 +1,25 @@
+#ifndef DROPBEAR_BENCH_H
+#define DROPBEAR_BENCH_H
+
+#include "includes.h"
+
+/* Standalone benchmarks. Like the fuzzers they are linked against the
+ * objects dropbear is built from, each bench-*.c has its own main() and
+ * uses bench-harness.c for timing. Built by "ndk-build BENCH=1", see
+ * jni/Android.mk */
+
+/* Each measurement is the best of this many rounds */
+#define BENCH_ROUNDS 5
+/* Default length of a measurement in milliseconds, -t changes it */
+#define BENCH_DEFAULT_MSEC 500
+
+/* Handles -t <msec> and -v, sets up crypto and the random pool */
+void bench_setup(int argc, char ** argv);
+
+/* Microseconds per call of fn(arg), the best of BENCH_ROUNDS rounds */
+double bench_time(void (*fn)(void *arg), void *arg);
+
+/* One line of output, name and time per call (and calls per second) */
+void bench_print(const char *name, double usec);
+
+#endif /* DROPBEAR_BENCH_H */
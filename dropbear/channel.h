@@ -28,6 +28,7 @@
 #include "includes.h"
 #include "buffer.h"
 #include "circbuffer.h"
+#include "packet.h"
 
 #define SSH_OPEN_ADMINISTRATIVELY_PROHIBITED    1
 #define SSH_OPEN_CONNECT_FAILED                 2
@@ -54,6 +55,19 @@ struct Channel {
 	unsigned int remotechan;
 	unsigned int recvwindow, transwindow;
 	unsigned int recvdonelen;
+	/* Receive window autotuning, see grow_recv_window(). recvwinsize is
+	 * the current total window and the size of writebuf/extrabuf, between
+	 * RECV_INITIAL_WINDOW and opts.recv_window */
+	unsigned int recvwinsize;
+	unsigned int recvtotal; /* channel data received, wraps */
+	struct timespec recvadjust_time; /* last window adjust sent */
+	/* data past recvtotal == rttprobe was sent after the peer saw the
+	 * window adjust at rttprobe_time */
+	int rttprobing;
+	unsigned int rttprobe;
+	struct timespec rttprobe_time;
+	unsigned int recvrtt; /* usec, smallest sample, 0 until measured */
+	unsigned int recvcheck; /* recvtotal at the last shrinkchannelbufs() */
 	unsigned int recvmaxpacket, transmaxpacket;
 	void* typedata; /* a pointer to type specific data */
 	int writefd; /* read from wire, written to insecure side */
@@ -85,6 +99,14 @@ struct Channel {
 	const struct ChanType* type;
 
 	enum dropbear_channel_prio prio;
+
+#ifndef DISABLE_ZLIB
+	struct compress_sample compress;
+#endif
+
+	/* fds registered with dbev_set(), see update_channel_events() */
+	int evfds[3];
+	unsigned int nevfds;
 };
 
 struct ChanType {
@@ -109,8 +131,9 @@ void channel_connect_done(int result, int sock, void* user_data, const char* err
 
 void chaninitialise(const struct ChanType *chantypes[]);
 void chancleanup(void);
-void setchannelfds(fd_set *readfds, fd_set *writefds, int allow_reads);
-void channelio(const fd_set *readfd, const fd_set *writefd);
+void setchannelevents(int allow_reads);
+void channelio(void);
+void shrinkchannelbufs(void);
 struct Channel* getchannel(void);
 /* Returns an arbitrary channel that is in a ready state - not
 being initialised and no EOF in either direction. NULL if none. */
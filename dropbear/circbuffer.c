@@ -28,6 +28,11 @@
 
 #define MAX_CBUF_SIZE 100000000
 
+/* The buffer holds up to size bytes, but only alloc bytes of storage are
+ * allocated. Storage is malloced on first write, grows in CBUF_ALLOC_CHUNK
+ * steps when a write doesn't fit, and is freed by cbuf_shrink() once the
+ * buffer is empty. readpos and writepos are offsets into the storage */
+
 circbuffer * cbuf_new(unsigned int size) {
 
 	circbuffer *cbuf = NULL;
@@ -39,6 +44,7 @@ circbuffer * cbuf_new(unsigned int size) {
 	cbuf = (circbuffer*)m_malloc(sizeof(circbuffer));
 	/* data is malloced on first write */
 	cbuf->data = NULL;
+	cbuf->alloc = 0;
 	cbuf->used = 0;
 	cbuf->readpos = 0;
 	cbuf->writepos = 0;
@@ -50,12 +56,68 @@ circbuffer * cbuf_new(unsigned int size) {
 void cbuf_free(circbuffer * cbuf) {
 
 	if (cbuf->data) {
-		m_burn(cbuf->data, cbuf->size);
+		m_burn(cbuf->data, cbuf->alloc);
 		m_free(cbuf->data);
 	}
 	m_free(cbuf);
 }
 
+void cbuf_resize(circbuffer * cbuf, unsigned int size) {
+
+	if (size > MAX_CBUF_SIZE || size < cbuf->size) {
+		dropbear_exit("Bad cbuf size");
+	}
+
+	/* storage grows when it's written */
+	cbuf->size = size;
+}
+
+/* Replace the storage with at least minalloc bytes, the contents are
+ * moved to the start */
+static void cbuf_realloc(circbuffer * cbuf, unsigned int minalloc) {
+
+	unsigned char *newdata = NULL;
+	unsigned char *p1, *p2;
+	unsigned int len1, len2;
+	unsigned int newalloc;
+
+	newalloc = MAX(minalloc, 2*cbuf->alloc);
+	newalloc = (newalloc + CBUF_ALLOC_CHUNK - 1) / CBUF_ALLOC_CHUNK * CBUF_ALLOC_CHUNK;
+	newalloc = MIN(newalloc, cbuf->size);
+	dropbear_assert(newalloc >= minalloc);
+
+	newdata = (unsigned char*)m_malloc(newalloc);
+	if (cbuf->data) {
+		cbuf_readptrs(cbuf, &p1, &len1, &p2, &len2);
+		memcpy(newdata, p1, len1);
+		if (len2 > 0) {
+			memcpy(&newdata[len1], p2, len2);
+		}
+		m_burn(cbuf->data, cbuf->alloc);
+		m_free(cbuf->data);
+	}
+
+	TRACE2(("cbuf_realloc %u -> %u, used %u", cbuf->alloc, newalloc, cbuf->used))
+	cbuf->data = newdata;
+	cbuf->alloc = newalloc;
+	cbuf->readpos = 0;
+	cbuf->writepos = cbuf->used % newalloc;
+}
+
+void cbuf_shrink(circbuffer * cbuf) {
+
+	if (cbuf->used > 0 || !cbuf->data) {
+		return;
+	}
+
+	TRACE2(("cbuf_shrink %u", cbuf->alloc))
+	m_burn(cbuf->data, cbuf->alloc);
+	m_free(cbuf->data);
+	cbuf->alloc = 0;
+	cbuf->readpos = 0;
+	cbuf->writepos = 0;
+}
+
 unsigned int cbuf_getused(const circbuffer * cbuf) {
 
 	return cbuf->used;
@@ -68,29 +130,51 @@ unsigned int cbuf_getavail(const circbuffer * cbuf) {
 
 }
 
+unsigned int cbuf_getalloc(const circbuffer * cbuf) {
+
+	return cbuf->alloc;
+
+}
+
 unsigned int cbuf_writelen(const circbuffer *cbuf) {
 
-	dropbear_assert(cbuf->used <= cbuf->size);
-	dropbear_assert(((2*cbuf->size)+cbuf->writepos-cbuf->readpos)%cbuf->size == cbuf->used%cbuf->size);
-	dropbear_assert(((2*cbuf->size)+cbuf->readpos-cbuf->writepos)%cbuf->size == (cbuf->size-cbuf->used)%cbuf->size);
+	dropbear_assert(cbuf->used <= cbuf->alloc || (cbuf->used == 0 && !cbuf->data));
+	dropbear_assert(cbuf->alloc <= cbuf->size);
 
 	if (cbuf->used == cbuf->size) {
 		TRACE(("cbuf_writelen: full buffer"))
 		return 0; /* full */
 	}
+
+	if (cbuf->used == cbuf->alloc) {
+		/* cbuf_writeptr() will grow the storage, contents are
+		 * moved to the start so the rest is linear */
+		return cbuf->size - cbuf->used;
+	}
+
+	dropbear_assert(((2*cbuf->alloc)+cbuf->writepos-cbuf->readpos)%cbuf->alloc == cbuf->used%cbuf->alloc);
 	
 	if (cbuf->writepos < cbuf->readpos) {
 		return cbuf->readpos - cbuf->writepos;
 	}
 
-	return cbuf->size - cbuf->writepos;
+	return cbuf->alloc - cbuf->writepos;
 }
 
 void cbuf_readptrs(const circbuffer *cbuf,
 	unsigned char **p1, unsigned int *len1, 
 	unsigned char **p2, unsigned int *len2) {
+
+	if (cbuf->used == 0) {
+		*p1 = cbuf->data;
+		*len1 = 0;
+		*p2 = NULL;
+		*len2 = 0;
+		return;
+	}
+
 	*p1 = &cbuf->data[cbuf->readpos];
-	*len1 = MIN(cbuf->used, cbuf->size - cbuf->readpos);
+	*len1 = MIN(cbuf->used, cbuf->alloc - cbuf->readpos);
 
 	if (*len1 < cbuf->used) {
 		*p2 = cbuf->data;
@@ -107,9 +191,8 @@ unsigned char* cbuf_writeptr(circbuffer *cbuf, unsigned int len) {
 		dropbear_exit("Bad cbuf write");
 	}
 
-	if (!cbuf->data) {
-		/* lazy allocation */
-		cbuf->data = (unsigned char*)m_malloc(cbuf->size);
+	if (len > 0 && cbuf->used == cbuf->alloc) {
+		cbuf_realloc(cbuf, cbuf->used + len);
 	}
 
 	return &cbuf->data[cbuf->writepos];
@@ -119,15 +202,26 @@ void cbuf_incrwrite(circbuffer *cbuf, unsigned int len) {
 	if (len > cbuf_writelen(cbuf)) {
 		dropbear_exit("Bad cbuf write");
 	}
+	if (len == 0) {
+		return;
+	}
 
 	cbuf->used += len;
-	dropbear_assert(cbuf->used <= cbuf->size);
-	cbuf->writepos = (cbuf->writepos + len) % cbuf->size;
+	dropbear_assert(cbuf->used <= cbuf->alloc);
+	cbuf->writepos = (cbuf->writepos + len) % cbuf->alloc;
 }
 
 
 void cbuf_incrread(circbuffer *cbuf, unsigned int len) {
 	dropbear_assert(cbuf->used >= len);
+	if (len == 0) {
+		return;
+	}
 	cbuf->used -= len;
-	cbuf->readpos = (cbuf->readpos + len) % cbuf->size;
+	if (cbuf->used == 0) {
+		/* start from the beginning, writes stay linear */
+		cbuf->readpos = cbuf->writepos = 0;
+	} else {
+		cbuf->readpos = (cbuf->readpos + len) % cbuf->alloc;
+	}
 }
@@ -26,7 +26,8 @@
 #define DROPBEAR_CIRCBUFFER_H_
 struct circbuf {
 
-	unsigned int size;
+	unsigned int size; /* the most it can hold */
+	unsigned int alloc; /* length of data */
 	unsigned int readpos;
 	unsigned int writepos;
 	unsigned int used;
@@ -37,9 +38,14 @@ typedef struct circbuf circbuffer;
 
 circbuffer * cbuf_new(unsigned int size);
 void cbuf_free(circbuffer * cbuf);
+/* let the buffer hold up to size, larger than before */
+void cbuf_resize(circbuffer * cbuf, unsigned int size);
+/* free the storage if the buffer is empty */
+void cbuf_shrink(circbuffer * cbuf);
 
 unsigned int cbuf_getused(const circbuffer * cbuf); /* how much data stored */
 unsigned int cbuf_getavail(const circbuffer * cbuf); /* how much we can write */
+unsigned int cbuf_getalloc(const circbuffer * cbuf); /* how much memory held */
 unsigned int cbuf_writelen(const circbuffer *cbuf); /* max linear write len */
 
 /* returns pointers to the two portions of the circular buffer that can be read */
@@ -343,7 +343,7 @@ static int cli_init_stdpipe_sess(struct Channel *channel) {
 	channel->errfd = STDERR_FILENO;
 	setnonblocking(STDERR_FILENO);
 
-	channel->extrabuf = cbuf_new(opts.recv_window);
+	channel->extrabuf = cbuf_new(channel->recvwinsize);
 	return 0;
 }
 
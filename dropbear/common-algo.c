@@ -32,6 +32,7 @@
 #include "ecc.h"
 #include "gcm.h"
 #include "chachapoly.h"
+#include "umac.h"
 #include "ssh.h"
 
 /* This file (algo.c) organises the ciphers which can be used, and is used to
@@ -104,7 +105,7 @@ const struct dropbear_cipher_mode dropbear_mode_ctr =
 #endif /* DROPBEAR_ENABLE_CTR_MODE */
 
 /* Mapping of ssh hashes to libtomcrypt hashes, including keysize etc.
-   {&hash_desc, keysize, hashsize} */
+   {&hash_desc, keysize, hashsize, etm, umac} */
 
 #if DROPBEAR_SHA1_HMAC
 static const struct dropbear_hash dropbear_sha1 = 
@@ -126,6 +127,26 @@ static const struct dropbear_hash dropbear_sha2_512 =
 static const struct dropbear_hash dropbear_md5 = 
 	{&md5_desc, 16, 16};
 #endif
+#if DROPBEAR_ENABLE_ETM_MODE
+#if DROPBEAR_SHA1_HMAC
+static const struct dropbear_hash dropbear_sha1_etm = 
+	{&sha1_desc, 20, 20, 1};
+#endif
+#if DROPBEAR_SHA2_256_HMAC
+static const struct dropbear_hash dropbear_sha2_256_etm = 
+	{&sha256_desc, 32, 32, 1};
+#endif
+#if DROPBEAR_SHA2_512_HMAC
+static const struct dropbear_hash dropbear_sha2_512_etm =
+	{&sha512_desc, 64, 64, 1};
+#endif
+#if DROPBEAR_UMAC
+static const struct dropbear_hash dropbear_umac64_etm =
+	{NULL, UMAC_KEY_LEN, 8, 1, 1};
+static const struct dropbear_hash dropbear_umac128_etm =
+	{NULL, UMAC_KEY_LEN, 16, 1, 1};
+#endif
+#endif /* DROPBEAR_ENABLE_ETM_MODE */
 
 const struct dropbear_hash dropbear_nohash =
 	{NULL, 16, 0}; /* used initially */
@@ -198,6 +219,21 @@ algo_type sshciphers[] = {
 };
 
 algo_type sshhashes[] = {
+#if DROPBEAR_ENABLE_ETM_MODE
+#if DROPBEAR_UMAC
+	{"umac-64-etm@openssh.com", 0, &dropbear_umac64_etm, 1, NULL},
+	{"umac-128-etm@openssh.com", 0, &dropbear_umac128_etm, 1, NULL},
+#endif
+#if DROPBEAR_SHA2_256_HMAC
+	{"hmac-sha2-256-etm@openssh.com", 0, &dropbear_sha2_256_etm, 1, NULL},
+#endif
+#if DROPBEAR_SHA2_512_HMAC
+	{"hmac-sha2-512-etm@openssh.com", 0, &dropbear_sha2_512_etm, 1, NULL},
+#endif
+#if DROPBEAR_SHA1_HMAC
+	{"hmac-sha1-etm@openssh.com", 0, &dropbear_sha1_etm, 1, NULL},
+#endif
+#endif /* DROPBEAR_ENABLE_ETM_MODE */
 #if DROPBEAR_SHA1_96_HMAC
 	{"hmac-sha1-96", 0, &dropbear_sha1_96, 1, NULL},
 #endif
@@ -35,6 +35,7 @@
 #include "listener.h"
 #include "runopts.h"
 #include "netio.h"
+#include "dbevent.h"
 
 static void send_msg_channel_open_failure(unsigned int remotechan, int reason,
 		const char *text, const char *lang);
@@ -46,12 +47,18 @@ static int writechannel(struct Channel* channel, int fd, circbuffer *cbuf,
 static void send_msg_channel_window_adjust(const struct Channel *channel,
 		unsigned int incr);
 static void send_msg_channel_data(struct Channel *channel, int isextended);
+static void discard_channel_data(buffer *buf);
 static void send_msg_channel_eof(struct Channel *channel);
 static void send_msg_channel_close(struct Channel *channel);
 static void remove_channel(struct Channel *channel);
 static unsigned int write_pending(const struct Channel * channel);
 static void check_close(struct Channel *channel);
 static void close_chan_fd(struct Channel *channel, int fd, int how);
+static void mark_channel_dirty(const struct Channel *channel);
+static void update_channel_events(struct Channel *channel, int allow_reads);
+static void clear_channel_events(struct Channel *channel);
+static unsigned int grow_recv_window(struct Channel *channel,
+		const struct timespec *now);
 
 #define FD_UNINIT (-2)
 #define FD_CLOSED (-1)
@@ -75,6 +82,12 @@ void chaninitialise(const struct ChanType *chantypes[]) {
 	ses.channels[0] = NULL;
 	ses.chancount = 0;
 
+	ses.chandirty = (unsigned int*)m_malloc(sizeof(unsigned int));
+	ses.chanisdirty = (unsigned char*)m_malloc(1);
+	ses.chanisdirty[0] = 0;
+	ses.chandirtycount = 0;
+	ses.chanreadsopen = 0;
+
 	ses.chantypes = chantypes;
 
 #if DROPBEAR_LISTENERS
@@ -96,9 +109,43 @@ void chancleanup() {
 		}
 	}
 	m_free(ses.channels);
+	m_free(ses.chandirty);
+	m_free(ses.chanisdirty);
 	TRACE(("leave chancleanup"))
 }
 
+/* Free the receive buffers of channels that have emptied them and not
+ * received any data since the last call, so that idle channels don't
+ * hold on to memory. Called every CHANNEL_BUF_IDLE_SECS while any
+ * buffers are held */
+void shrinkchannelbufs() {
+
+	unsigned int i;
+	struct Channel *channel;
+	int held = 0;
+
+	for (i = 0; i < ses.chansize; i++) {
+		channel = ses.channels[i];
+		if (channel == NULL) {
+			continue;
+		}
+
+		if (channel->recvtotal == channel->recvcheck) {
+			cbuf_shrink(channel->writebuf);
+			if (channel->extrabuf) {
+				cbuf_shrink(channel->extrabuf);
+			}
+		}
+		channel->recvcheck = channel->recvtotal;
+
+		if (cbuf_getalloc(channel->writebuf) > 0
+				|| (channel->extrabuf && cbuf_getalloc(channel->extrabuf) > 0)) {
+			held = 1;
+		}
+	}
+	ses.chanbufsheld = held;
+}
+
 /* Create a new channel entry, send a reply confirm or failure */
 /* If remotechan, transwindow and transmaxpacket are not know (for a new
  * outgoing connection, with them to be filled on confirmation), they should
@@ -130,11 +177,17 @@ static struct Channel* newchannel(unsigned int remotechan,
 		ses.channels = (struct Channel**)m_realloc(ses.channels,
 				(ses.chansize+CHAN_EXTEND_SIZE)*sizeof(struct Channel*));
 
+		ses.chandirty = (unsigned int*)m_realloc(ses.chandirty,
+				(ses.chansize+CHAN_EXTEND_SIZE)*sizeof(unsigned int));
+		ses.chanisdirty = (unsigned char*)m_realloc(ses.chanisdirty,
+				ses.chansize+CHAN_EXTEND_SIZE);
+
 		ses.chansize += CHAN_EXTEND_SIZE;
 
 		/* set the new channels to null */
 		for (j = i; j < ses.chansize; j++) {
 			ses.channels[j] = NULL;
+			ses.chanisdirty[j] = 0;
 		}
 
 	}
@@ -156,18 +209,29 @@ static struct Channel* newchannel(unsigned int remotechan,
 	newchan->await_open = 0;
 	newchan->flushing = 0;
 
-	newchan->writebuf = cbuf_new(opts.recv_window);
-	newchan->recvwindow = opts.recv_window;
+	newchan->recvwinsize = MIN(opts.recv_window, RECV_INITIAL_WINDOW);
+	newchan->writebuf = cbuf_new(newchan->recvwinsize);
+	newchan->recvwindow = newchan->recvwinsize;
 
 	newchan->extrabuf = NULL; /* The user code can set it up */
 	newchan->recvdonelen = 0;
+	newchan->recvtotal = 0;
+	newchan->recvcheck = 0;
+	newchan->rttprobing = 0;
+	newchan->recvrtt = 0;
+	gettime_wrapper(&newchan->recvadjust_time);
 	newchan->recvmaxpacket = RECV_MAX_CHANNEL_DATA_LEN;
 
 	newchan->prio = DROPBEAR_CHANNEL_PRIO_EARLY; /* inithandler sets it */
 
+	newchan->nevfds = 0;
+
 	ses.channels[i] = newchan;
 	ses.chancount++;
 
+	/* the fds are usually set up after this returns */
+	mark_channel_dirty(newchan);
+
 	TRACE(("leave newchannel"))
 
 	return newchan;
@@ -189,6 +253,8 @@ static struct Channel* getchannel_msg(const char* kind) {
 			dropbear_exit("Unknown channel %d", chan);
 		}
 	}
+	/* any message can change what the channel is waiting for */
+	mark_channel_dirty(ses.channels[chan]);
 	return ses.channels[chan];
 }
 
@@ -196,65 +262,93 @@ struct Channel* getchannel() {
 	return getchannel_msg(NULL);
 }
 
-/* Iterate through the channels, performing IO if available */
-void channelio(const fd_set *readfds, const fd_set *writefds) {
+/* Perform IO on a channel's ready fds */
+static void channel_ready_io(struct Channel *channel) {
 
-	/* Listeners such as TCP, X11, agent-auth */
-	struct Channel *channel;
-	unsigned int i;
+	/* Close checking only needs to occur for channels that had IO events */
+	int do_check_close = 0;
+	int readfd = channel->readfd, writefd = channel->writefd;
+	int errfd = channel->errfd;
 
-	/* foreach channel */
-	for (i = 0; i < ses.chansize; i++) {
-		/* Close checking only needs to occur for channels that had IO events */
-		int do_check_close = 0;
+	/* read data and send it over the wire */
+	if (channel->readfd >= 0 && (dbev_ready(channel->readfd) & DBEV_READ)) {
+		TRACE(("send normal readfd"))
+		send_msg_channel_data(channel, 0);
+		do_check_close = 1;
+	}
 
-		channel = ses.channels[i];
-		if (channel == NULL) {
-			/* only process in-use channels */
-			continue;
-		}
+	/* read stderr data and send it over the wire */
+	if (ERRFD_IS_READ(channel) && channel->errfd >= 0 
+		&& (dbev_ready(channel->errfd) & DBEV_READ)) {
+			TRACE(("send normal errfd"))
+			send_msg_channel_data(channel, 1);
+		do_check_close = 1;
+	}
 
-		/* read data and send it over the wire */
-		if (channel->readfd >= 0 && FD_ISSET(channel->readfd, readfds)) {
-			TRACE(("send normal readfd"))
-			send_msg_channel_data(channel, 0);
-			do_check_close = 1;
-		}
+	/* write to program/pipe stdin */
+	if (channel->writefd >= 0 && (dbev_ready(channel->writefd) & DBEV_WRITE)) {
+		writechannel(channel, channel->writefd, channel->writebuf, NULL, NULL);
+		do_check_close = 1;
+	}
+	
+	/* stderr for client mode */
+	if (ERRFD_IS_WRITE(channel)
+			&& channel->errfd >= 0 && (dbev_ready(channel->errfd) & DBEV_WRITE)) {
+		writechannel(channel, channel->errfd, channel->extrabuf, NULL, NULL);
+		do_check_close = 1;
+	}
 
-		/* read stderr data and send it over the wire */
-		if (ERRFD_IS_READ(channel) && channel->errfd >= 0 
-			&& FD_ISSET(channel->errfd, readfds)) {
-				TRACE(("send normal errfd"))
-				send_msg_channel_data(channel, 1);
-			do_check_close = 1;
-		}
+	/* a channel with several ready fds is in the ready list more
+	 * than once, it has been dealt with now */
+	dbev_consume(readfd);
+	dbev_consume(writefd);
+	dbev_consume(errfd);
 
-		/* write to program/pipe stdin */
-		if (channel->writefd >= 0 && FD_ISSET(channel->writefd, writefds)) {
-			writechannel(channel, channel->writefd, channel->writebuf, NULL, NULL);
-			do_check_close = 1;
-		}
-		
-		/* stderr for client mode */
-		if (ERRFD_IS_WRITE(channel)
-				&& channel->errfd >= 0 && FD_ISSET(channel->errfd, writefds)) {
-			writechannel(channel, channel->errfd, channel->extrabuf, NULL, NULL);
-			do_check_close = 1;
-		}
+	if (ses.channel_signal_pending) {
+		/* SIGCHLD can change channel state for server sessions */
+		do_check_close = 1;
+	}
 
-		if (ses.channel_signal_pending) {
-			/* SIGCHLD can change channel state for server sessions */
-			do_check_close = 1;
+	/* handle any channel closing etc */
+	if (do_check_close) {
+		mark_channel_dirty(channel);
+		check_close(channel);
+	}
+}
+
+/* Perform IO for the channels with ready fds */
+void channelio() {
+
+	/* Listeners such as TCP, X11, agent-auth */
+	struct Channel *channel;
+	unsigned int i, n;
+	int chan;
+
+	if (ses.channel_signal_pending) {
+		/* every channel needs checking */
+		for (i = 0; i < ses.chansize; i++) {
+			channel = ses.channels[i];
+			if (channel != NULL) {
+				channel_ready_io(channel);
+			}
 		}
-	
-		/* handle any channel closing etc */
-		if (do_check_close) {
-			check_close(channel);
+	} else {
+		n = dbev_ready_count();
+		for (i = 0; i < n; i++) {
+			chan = dbev_ready_chan(i);
+			if (chan == DBEV_NO_CHANNEL || (unsigned int)chan >= ses.chansize) {
+				continue;
+			}
+			channel = ses.channels[chan];
+			/* it may have been removed by now */
+			if (channel != NULL) {
+				channel_ready_io(channel);
+			}
 		}
 	}
 
 #if DROPBEAR_LISTENERS
-	handle_listeners(readfds);
+	handle_listeners();
 #endif
 }
 
@@ -366,6 +460,7 @@ void channel_connect_done(int result, int sock, void* user_data, const char* UNU
 	{
 		channel->readfd = channel->writefd = sock;
 		channel->conn_pending = NULL;
+		mark_channel_dirty(channel);
 		send_msg_channel_open_confirmation(channel, channel->recvwindow,
 				channel->recvmaxpacket);
 		TRACE(("leave channel_connect_done: success"))
@@ -524,6 +619,8 @@ static int writechannel_writev(struct Channel* channel, int fd, circbuffer *cbuf
 static int writechannel(struct Channel* channel, int fd, circbuffer *cbuf,
 	const unsigned char *moredata, unsigned int *morelen) {
 	int ret = DROPBEAR_SUCCESS;
+	struct timespec now;
+	unsigned int incr;
 	TRACE(("enter writechannel fd %d", fd))
 #ifdef HAVE_WRITEV
 	ret = writechannel_writev(channel, fd, cbuf, moredata, morelen);
@@ -532,13 +629,22 @@ static int writechannel(struct Channel* channel, int fd, circbuffer *cbuf,
 #endif
 
 	/* Window adjust handling */
-	if (channel->recvdonelen >= RECV_WINDOWEXTEND) {
-		send_msg_channel_window_adjust(channel, channel->recvdonelen);
-		channel->recvwindow += channel->recvdonelen;
+	if (channel->recvdonelen >= RECV_WINDOWEXTEND(channel)) {
+		gettime_wrapper(&now);
+		if (!channel->rttprobing) {
+			/* the peer can't send past here until it has this adjust */
+			channel->rttprobing = 1;
+			channel->rttprobe = channel->recvtotal + channel->recvwindow;
+			channel->rttprobe_time = now;
+		}
+		incr = channel->recvdonelen + grow_recv_window(channel, &now);
+		send_msg_channel_window_adjust(channel, incr);
+		channel->recvwindow += incr;
 		channel->recvdonelen = 0;
+		channel->recvadjust_time = now;
 	}
 
-	dropbear_assert(channel->recvwindow <= opts.recv_window);
+	dropbear_assert(channel->recvwindow <= channel->recvwinsize);
 	dropbear_assert(channel->recvwindow <= cbuf_getavail(channel->writebuf));
 	dropbear_assert(channel->extrabuf == NULL ||
 			channel->recvwindow <= cbuf_getavail(channel->extrabuf));
@@ -547,54 +653,185 @@ static int writechannel(struct Channel* channel, int fd, circbuffer *cbuf,
 	return ret;
 }
 
+static unsigned int elapsed_usec(const struct timespec *start,
+		const struct timespec *end) {
 
-/* Set the file descriptors for the main select in session.c
- * This avoid channels which don't have any window available, are closed, etc*/
-void setchannelfds(fd_set *readfds, fd_set *writefds, int allow_reads) {
-	
+	time_t sec = end->tv_sec - start->tv_sec;
+	long nsec = end->tv_nsec - start->tv_nsec;
+
+	if (sec < 0 || (sec == 0 && nsec < 0)) {
+		return 0;
+	}
+	if (sec >= 1000) {
+		return 1000000000;
+	}
+	return sec * 1000000 + nsec / 1000;
+}
+
+/* Called when sending a window adjust, returns how much the window should
+ * grow by in addition to the consumed data. The rate recvdonelen was
+ * drained at since the last adjust times the RTT is the bandwidth-delay
+ * product; while the window is less than twice that the peer is probably
+ * waiting on window adjusts, so the window (and buffers) grow by up to
+ * double each time. A peer limited by the link, or a local side that
+ * drains slowly, keeps the window where it is */
+static unsigned int grow_recv_window(struct Channel *channel,
+		const struct timespec *now) {
+
+	unsigned long long target;
+	unsigned int interval, newsize;
+
+	if (channel->recvrtt == 0 || channel->recvwinsize >= opts.recv_window) {
+		return 0;
+	}
+
+	interval = elapsed_usec(&channel->recvadjust_time, now);
+	if (interval == 0) {
+		return 0;
+	}
+
+	target = 2ULL * channel->recvdonelen * channel->recvrtt / interval;
+	if (target <= channel->recvwinsize) {
+		return 0;
+	}
+	target = MIN(target, 2ULL * channel->recvwinsize);
+	newsize = MIN(target, opts.recv_window);
+
+	TRACE(("channel %d recv window %u -> %u, rtt %u us, interval %u us",
+		channel->index, channel->recvwinsize, newsize,
+		channel->recvrtt, interval))
+
+	cbuf_resize(channel->writebuf, newsize);
+	if (channel->extrabuf) {
+		cbuf_resize(channel->extrabuf, newsize);
+	}
+	newsize -= channel->recvwinsize;
+	channel->recvwinsize += newsize;
+	return newsize;
+}
+
+
+static void mark_channel_dirty(const struct Channel *channel) {
+	if (!ses.chanisdirty[channel->index]) {
+		ses.chanisdirty[channel->index] = 1;
+		ses.chandirty[ses.chandirtycount] = channel->index;
+		ses.chandirtycount++;
+	}
+}
+
+/* Add events for one of a channel's fds, readfd and writefd are often
+ * the same socket */
+static void add_channel_fd(int *fds, unsigned int *events, unsigned int *n,
+		int fd, unsigned int ev) {
 	unsigned int i;
-	struct Channel * channel;
-	
-	for (i = 0; i < ses.chansize; i++) {
 
-		channel = ses.channels[i];
-		if (channel == NULL) {
-			continue;
+	if (fd < 0) {
+		return;
+	}
+	for (i = 0; i < *n; i++) {
+		if (fds[i] == fd) {
+			events[i] |= ev;
+			return;
 		}
+	}
+	fds[*n] = fd;
+	events[*n] = ev;
+	(*n)++;
+}
 
-		/* Stuff to put over the wire. 
-		Avoid queueing data to send if we're in the middle of a 
-		key re-exchange (!dataallowed), but still read from the 
-		FD if there's the possibility of "~."" to kill an 
-		interactive session (the read_mangler) */
-		if (channel->transwindow > 0
-		   && ((ses.dataallowed && allow_reads) || channel->read_mangler)) {
+/* Set what the main loop waits for on a channel's fds.
+ * This avoids channels which don't have any window available, are closed, etc */
+static void update_channel_events(struct Channel *channel, int allow_reads) {
+
+	int fds[3];
+	unsigned int events[3];
+	unsigned int i, j, n = 0;
+	unsigned int readev = 0, writeev = 0, errev = 0;
+
+	/* Stuff to put over the wire. 
+	Avoid queueing data to send if we're in the middle of a 
+	key re-exchange (!dataallowed), but still read from the 
+	FD if there's the possibility of "~."" to kill an 
+	interactive session (the read_mangler) */
+	if (channel->transwindow > 0
+	   && ((ses.dataallowed && allow_reads) || channel->read_mangler)) {
+		readev = DBEV_READ;
+		if (ERRFD_IS_READ(channel)) {
+			errev = DBEV_READ;
+		}
+	}
 
-			if (channel->readfd >= 0) {
-				FD_SET(channel->readfd, readfds);
-			}
-			
-			if (ERRFD_IS_READ(channel) && channel->errfd >= 0) {
-					FD_SET(channel->errfd, readfds);
+	/* Stuff from the wire */
+	if (cbuf_getused(channel->writebuf) > 0) {
+		writeev = DBEV_WRITE;
+	}
+
+	if (ERRFD_IS_WRITE(channel) && cbuf_getused(channel->extrabuf) > 0) {
+		errev = DBEV_WRITE;
+	}
+
+	add_channel_fd(fds, events, &n, channel->readfd, readev);
+	add_channel_fd(fds, events, &n, channel->writefd, writeev);
+	add_channel_fd(fds, events, &n, channel->errfd, errev);
+
+	/* fds the channel no longer uses, such as after shutdown() */
+	for (i = 0; i < channel->nevfds; i++) {
+		for (j = 0; j < n; j++) {
+			if (fds[j] == channel->evfds[i]) {
+				break;
 			}
 		}
-
-		/* Stuff from the wire */
-		if (channel->writefd >= 0 && cbuf_getused(channel->writebuf) > 0) {
-				FD_SET(channel->writefd, writefds);
+		if (j == n && dbev_owner(channel->evfds[i]) == (int)channel->index) {
+			dbev_set(channel->evfds[i], 0, DBEV_NO_CHANNEL);
 		}
+	}
 
-		if (ERRFD_IS_WRITE(channel) && channel->errfd >= 0 
-				&& cbuf_getused(channel->extrabuf) > 0) {
-				FD_SET(channel->errfd, writefds);
-		}
+	for (j = 0; j < n; j++) {
+		dbev_set(fds[j], events[j], channel->index);
+		channel->evfds[j] = fds[j];
+	}
+	channel->nevfds = n;
+}
 
-	} /* foreach channel */
+/* Stop waiting on a channel's fds, prior to it being removed */
+static void clear_channel_events(struct Channel *channel) {
+	unsigned int i;
 
-#if DROPBEAR_LISTENERS
-	set_listener_fds(readfds);
-#endif
+	for (i = 0; i < channel->nevfds; i++) {
+		if (dbev_owner(channel->evfds[i]) == (int)channel->index) {
+			dbev_forget(channel->evfds[i]);
+		}
+	}
+	channel->nevfds = 0;
+}
 
+/* Update the wait events of channels that have changed since the last
+ * iteration of the main loop in session.c */
+void setchannelevents(int allow_reads) {
+	
+	unsigned int i, index;
+	struct Channel * channel;
+	int readsopen = ses.dataallowed && allow_reads;
+
+	/* starting or stopping reads affects every channel */
+	if (readsopen != ses.chanreadsopen) {
+		ses.chanreadsopen = readsopen;
+		for (i = 0; i < ses.chansize; i++) {
+			if (ses.channels[i] != NULL) {
+				mark_channel_dirty(ses.channels[i]);
+			}
+		}
+	}
+
+	for (i = 0; i < ses.chandirtycount; i++) {
+		index = ses.chandirty[i];
+		ses.chanisdirty[index] = 0;
+		channel = ses.channels[index];
+		if (channel != NULL) {
+			update_channel_events(channel, allow_reads);
+		}
+	}
+	ses.chandirtycount = 0;
 }
 
 /* handle the channel EOF event, by closing the channel filedescriptor. The
@@ -637,6 +874,7 @@ static void remove_channel(struct Channel * channel) {
 
 	TRACE(("enter remove_channel"))
 	TRACE(("channel index is %d", channel->index))
+	TRACE(("recv window %u, rtt %u us", channel->recvwinsize, channel->recvrtt))
 
 	cbuf_free(channel->writebuf);
 	channel->writebuf = NULL;
@@ -647,6 +885,8 @@ static void remove_channel(struct Channel * channel) {
 	}
 
 
+	clear_channel_events(channel);
+
 	if (IS_DROPBEAR_SERVER || (channel->writefd != STDOUT_FILENO)) {
 		/* close the FDs in case they haven't been done
 		 * yet (they might have been shutdown etc) */
@@ -710,6 +950,8 @@ static void send_msg_channel_data(struct Channel *channel, int isextended) {
 	int len;
 	size_t maxlen, size_pos;
 	int fd;
+	unsigned char type;
+	buffer *buf;
 
 	CHECKCLEARTOWRITE();
 
@@ -735,18 +977,26 @@ static void send_msg_channel_data(struct Channel *channel, int isextended) {
 		return;
 	}
 
-	buf_putbyte(ses.writepayload, 
-			isextended ? SSH_MSG_CHANNEL_EXTENDED_DATA : SSH_MSG_CHANNEL_DATA);
-	buf_putint(ses.writepayload, channel->remotechan);
+	/* Read the data straight into the packet that goes on the wire, so it
+	 * is encrypted in place without copying the payload. Falls back to
+	 * ses.writepayload when that isn't possible. */
+	buf = new_writebuf(1 + 4 + 4 + (isextended ? 4 : 0) + maxlen);
+	if (buf == NULL) {
+		buf = ses.writepayload;
+	}
+
+	type = isextended ? SSH_MSG_CHANNEL_EXTENDED_DATA : SSH_MSG_CHANNEL_DATA;
+	buf_putbyte(buf, type);
+	buf_putint(buf, channel->remotechan);
 	if (isextended) {
-		buf_putint(ses.writepayload, SSH_EXTENDED_DATA_STDERR);
+		buf_putint(buf, SSH_EXTENDED_DATA_STDERR);
 	}
 	/* a dummy size first ...*/
-	size_pos = ses.writepayload->pos;
-	buf_putint(ses.writepayload, 0);
+	size_pos = buf->pos;
+	buf_putint(buf, 0);
 
 	/* read the data */
-	len = read(fd, buf_getwriteptr(ses.writepayload, maxlen), maxlen);
+	len = read(fd, buf_getwriteptr(buf, maxlen), maxlen);
 
 	if (len <= 0) {
 		if (len == 0 || errno != EINTR) {
@@ -755,31 +1005,40 @@ static void send_msg_channel_data(struct Channel *channel, int isextended) {
 			in which case it can be treated the same as EOF */
 			close_chan_fd(channel, fd, SHUT_RD);
 		}
-		buf_setpos(ses.writepayload, 0);
-		buf_setlen(ses.writepayload, 0);
+		discard_channel_data(buf);
 		TRACE(("leave send_msg_channel_data: len %d read err %d or EOF for fd %d", 
 					len, errno, fd))
 		return;
 	}
 
 	if (channel->read_mangler) {
-		channel->read_mangler(channel, buf_getwriteptr(ses.writepayload, len), &len);
+		channel->read_mangler(channel, buf_getwriteptr(buf, len), &len);
 		if (len == 0) {
-			buf_setpos(ses.writepayload, 0);
-			buf_setlen(ses.writepayload, 0);
+			discard_channel_data(buf);
 			return;
 		}
 	}
 
 	TRACE(("send_msg_channel_data: len %d fd %d", len, fd))
-	buf_incrwritepos(ses.writepayload, len);
+	buf_incrwritepos(buf, len);
 	/* ... real size here */
-	buf_setpos(ses.writepayload, size_pos);
-	buf_putint(ses.writepayload, len);
+	buf_setpos(buf, size_pos);
+	buf_putint(buf, len);
 
 	channel->transwindow -= len;
 
-	encrypt_packet();
+	if (buf == ses.writepayload) {
+#ifndef DISABLE_ZLIB
+		/* sample compression per channel, see compress_level() */
+		ses.compress_chan = &channel->compress;
+#endif
+		encrypt_packet();
+#ifndef DISABLE_ZLIB
+		ses.compress_chan = NULL;
+#endif
+	} else {
+		encrypt_writebuf(buf, type);
+	}
 	
 	/* If we receive less data than we requested when flushing, we've
 	   reached the equivalent of EOF */
@@ -791,6 +1050,16 @@ static void send_msg_channel_data(struct Channel *channel, int isextended) {
 	TRACE(("leave send_msg_channel_data"))
 }
 
+/* Drops a data packet that send_msg_channel_data() started building */
+static void discard_channel_data(buffer *buf) {
+	if (buf == ses.writepayload) {
+		buf_setpos(ses.writepayload, 0);
+		buf_setlen(ses.writepayload, 0);
+	} else {
+		packet_buf_free(buf);
+	}
+}
+
 /* We receive channel data */
 void recv_msg_channel_data() {
 
@@ -840,7 +1109,21 @@ void common_recv_msg_channel_data(struct Channel *channel, int fd,
 
 	dropbear_assert(channel->recvwindow >= datalen);
 	channel->recvwindow -= datalen;
-	dropbear_assert(channel->recvwindow <= opts.recv_window);
+	dropbear_assert(channel->recvwindow <= channel->recvwinsize);
+
+	channel->recvtotal += datalen;
+	if (channel->rttprobing
+			&& (int)(channel->recvtotal - channel->rttprobe) > 0) {
+		/* this data was sent after the peer received the probe adjust */
+		struct timespec now;
+		unsigned int rtt;
+		gettime_wrapper(&now);
+		rtt = MAX(elapsed_usec(&channel->rttprobe_time, &now), 1);
+		if (channel->recvrtt == 0 || rtt < channel->recvrtt) {
+			channel->recvrtt = rtt;
+		}
+		channel->rttprobing = 0;
+	}
 
 	/* Attempt to write the data immediately without having to put it in the circular buffer */
 	consumed = datalen;
@@ -855,6 +1138,9 @@ void common_recv_msg_channel_data(struct Channel *channel, int fd,
 	 * is payload data.
 	 * If the writechannel() failed then remaining data is discarded */
 	if (res == DROPBEAR_SUCCESS) {
+		if (datalen > 0) {
+			ses.chanbufsheld = 1;
+		}
 		len = datalen;
 		while (len > 0) {
 			buflen = cbuf_writelen(cbuf);
@@ -1083,6 +1369,7 @@ static void close_chan_fd(struct Channel *channel, int fd, int how) {
 		}
 	} else {
 		TRACE(("CLOSE some fd %d", fd))
+		dbev_forget(fd);
 		m_close(fd);
 		closein = closeout = 1;
 	}
@@ -1106,6 +1393,7 @@ static void close_chan_fd(struct Channel *channel, int fd, int how) {
 	if (channel->type->sepfds && channel->readfd == FD_CLOSED 
 		&& channel->writefd == FD_CLOSED && channel->errfd == FD_CLOSED) {
 		TRACE(("CLOSE (finally) of %d", fd))
+		dbev_forget(fd);
 		m_close(fd);
 	}
 }
@@ -1145,7 +1433,7 @@ int send_msg_channel_open_init(int fd, const struct ChanType *type) {
 	buf_putbyte(ses.writepayload, SSH_MSG_CHANNEL_OPEN);
 	buf_putstring(ses.writepayload, type->name, strlen(type->name));
 	buf_putint(ses.writepayload, chan->index);
-	buf_putint(ses.writepayload, opts.recv_window);
+	buf_putint(ses.writepayload, chan->recvwindow);
 	buf_putint(ses.writepayload, RECV_MAX_CHANNEL_DATA_LEN);
 
 	TRACE(("leave send_msg_channel_open_init()"))
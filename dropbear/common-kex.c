@@ -107,6 +107,13 @@ void send_msg_kexinit() {
 
 	ses.kexstate.sentkexinit = 1;
 
+	/* The server waits for the client's KEXINIT before it can generate
+	 * its kex keypair. Guess it while the KEXINIT is in flight instead,
+	 * unless the client's has already arrived */
+	if (IS_DROPBEAR_SERVER && !ses.kexstate.recvkexinit) {
+		ses.kexstate.prepare_kex = 1;
+	}
+
 	ses.newkeys = (struct key_context*)m_malloc(sizeof(struct key_context));
 
 	if (ses.send_kex_first_guess) {
@@ -241,6 +248,7 @@ static void kexinitialise() {
 	ses.kexstate.datarecv = 0;
 
 	ses.kexstate.our_first_follows_matches = 0;
+	ses.kexstate.prepare_kex = 0;
 
 	ses.kexstate.lastkextime = monotonic_now();
 
@@ -285,6 +293,42 @@ static void hashkeys(unsigned char *out, unsigned int outlen,
  * ses.newkeys is the new set of keys which are generated, these are only
  * taken into use after both sides have sent a newkeys message */
 
+/* Processes the HMAC inner and outer key pads once per key, rather than
+ * once per packet in make_mac(). UMAC expands its key here too. */
+void gen_mac_states(struct key_context_directional *key) {
+
+	const struct ltc_hash_descriptor *hash_desc = key->algo_mac->hash_desc;
+	unsigned char pad[MAXBLOCKSIZE];
+	unsigned int i;
+
+#if DROPBEAR_UMAC
+	if (key->algo_mac->umac) {
+		dropbear_umac_setup(&key->mac_state.umac, key->mackey,
+				key->algo_mac->hashsize);
+		return;
+	}
+#endif
+
+	/* keys longer than the block size would need hashing first */
+	dropbear_assert(key->algo_mac->keysize <= hash_desc->blocksize);
+
+	memset(pad, 0x0, sizeof(pad));
+	memcpy(pad, key->mackey, key->algo_mac->keysize);
+	for (i = 0; i < hash_desc->blocksize; i++) {
+		pad[i] ^= 0x36;
+	}
+	hash_desc->init(&key->mac_state.hmac.inner);
+	hash_desc->process(&key->mac_state.hmac.inner, pad, hash_desc->blocksize);
+
+	for (i = 0; i < hash_desc->blocksize; i++) {
+		pad[i] ^= 0x36 ^ 0x5c;
+	}
+	hash_desc->init(&key->mac_state.hmac.outer);
+	hash_desc->process(&key->mac_state.hmac.outer, pad, hash_desc->blocksize);
+
+	m_burn(pad, sizeof(pad));
+}
+
 static void gen_new_keys() {
 
 	unsigned char C2S_IV[MAX_IV_LEN];
@@ -363,16 +407,18 @@ static void gen_new_keys() {
 		}
 	}
 
-	if (ses.newkeys->trans.algo_mac->hash_desc != NULL) {
+	if (ses.newkeys->trans.algo_mac->hash_desc != NULL
+			|| ses.newkeys->trans.algo_mac->umac) {
 		hashkeys(ses.newkeys->trans.mackey, 
 				ses.newkeys->trans.algo_mac->keysize, &hs, mactransletter);
-		ses.newkeys->trans.hash_index = find_hash(ses.newkeys->trans.algo_mac->hash_desc->name);
+		gen_mac_states(&ses.newkeys->trans);
 	}
 
-	if (ses.newkeys->recv.algo_mac->hash_desc != NULL) {
+	if (ses.newkeys->recv.algo_mac->hash_desc != NULL
+			|| ses.newkeys->recv.algo_mac->umac) {
 		hashkeys(ses.newkeys->recv.mackey, 
 				ses.newkeys->recv.algo_mac->keysize, &hs, macrecvletter);
-		ses.newkeys->recv.hash_index = find_hash(ses.newkeys->recv.algo_mac->hash_desc->name);
+		gen_mac_states(&ses.newkeys->recv);
 	}
 
 	/* Ready to switch over */
@@ -445,12 +491,13 @@ static void gen_new_zstream_trans() {
 		ses.newkeys->trans.zstream->zalloc = dropbear_zalloc;
 		ses.newkeys->trans.zstream->zfree = dropbear_zfree;
 	
-		if (deflateInit2(ses.newkeys->trans.zstream, Z_DEFAULT_COMPRESSION,
+		if (deflateInit2(ses.newkeys->trans.zstream, opts.compress_level,
 					Z_DEFLATED, DROPBEAR_ZLIB_WINDOW_BITS, 
 					DROPBEAR_ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY)
 				!= Z_OK) {
 			dropbear_exit("zlib error");
 		}
+		ses.newkeys->trans.zlevel = opts.compress_level;
 	} else {
 		ses.newkeys->trans.zstream = NULL;
 	}
@@ -554,32 +601,66 @@ void recv_msg_kexinit() {
 	TRACE(("leave recv_msg_kexinit"))
 }
 
+/* An ephemeral keypair made before it was needed, by the listener before
+ * forking. gen_kex*_param() hands it out if it suits the negotiated kex.
+ * Each keypair is used at most once */
+static const struct dropbear_kex *spare_kex = NULL;
+static void *spare_param = NULL;
+
+/* Whether a keypair made for a can be used with b */
+static int kex_param_compatible(const struct dropbear_kex *a,
+		const struct dropbear_kex *b) {
+	if (a->mode != b->mode) {
+		return 0;
+	}
+	switch (a->mode) {
 #if DROPBEAR_NORMAL_DH
-static void load_dh_p(mp_int * dh_p)
+		case DROPBEAR_KEX_NORMAL_DH:
+			/* group14-sha1 and group14-sha256 share a group */
+			return a->dh_p_bytes == b->dh_p_bytes;
+#endif
+#if DROPBEAR_ECDH
+		case DROPBEAR_KEX_ECDH:
+			return a->ecc_curve == b->ecc_curve;
+#endif
+#if DROPBEAR_CURVE25519
+		case DROPBEAR_KEX_CURVE25519:
+			return 1;
+#endif
+	}
+	return 0;
+}
+
+static void* take_spare_param() {
+	void *param = NULL;
+	if (spare_param && kex_param_compatible(spare_kex, ses.newkeys->algo_kex)) {
+		TRACE(("using prepared kex keypair"))
+		param = spare_param;
+		spare_param = NULL;
+		spare_kex = NULL;
+	}
+	return param;
+}
+
+#if DROPBEAR_NORMAL_DH
+static void load_dh_p(mp_int * dh_p, const struct dropbear_kex *algo_kex)
 {
-	bytes_to_mp(dh_p, ses.newkeys->algo_kex->dh_p_bytes, 
-		ses.newkeys->algo_kex->dh_p_len);
+	bytes_to_mp(dh_p, algo_kex->dh_p_bytes, algo_kex->dh_p_len);
 }
 
-/* Initialises and generate one side of the diffie-hellman key exchange values.
- * See the transport rfc 4253 section 8 for details */
-/* dh_pub and dh_priv MUST be already initialised */
-struct kex_dh_param *gen_kexdh_param() {
+static struct kex_dh_param *make_kexdh_param(const struct dropbear_kex *algo_kex) {
 	struct kex_dh_param *param = NULL;
 
 	DEF_MP_INT(dh_p);
 	DEF_MP_INT(dh_q);
-	DEF_MP_INT(dh_g);
 
 	TRACE(("enter gen_kexdh_vals"))
 
 	param = m_malloc(sizeof(*param));
-	m_mp_init_multi(&param->pub, &param->priv, &dh_g, &dh_p, &dh_q, NULL);
+	m_mp_init_multi(&param->pub, &param->priv, &dh_p, &dh_q, NULL);
 
-	/* read the prime and generator*/
-	load_dh_p(&dh_p);
-	
-	mp_set_ul(&dh_g, DH_G_VAL);
+	/* read the prime */
+	load_dh_p(&dh_p, algo_kex);
 
 	/* calculate q = (p-1)/2 */
 	/* dh_priv is just a temp var here */
@@ -594,10 +675,18 @@ struct kex_dh_param *gen_kexdh_param() {
 	gen_random_mpint(&dh_q, &param->priv);
 
 	/* f = g^y mod p */
-	if (mp_exptmod(&dh_g, &param->priv, &dh_p, &param->pub) != MP_OKAY) {
-		dropbear_exit("Diffie-Hellman error");
+	dh_pow_g(algo_kex->dh_p_bytes, &dh_p, &param->priv, &param->pub);
+	mp_clear_multi(&dh_p, &dh_q, NULL);
+	return param;
+}
+
+/* Initialises and generate one side of the diffie-hellman key exchange values.
+ * See the transport rfc 4253 section 8 for details */
+struct kex_dh_param *gen_kexdh_param() {
+	struct kex_dh_param *param = take_spare_param();
+	if (!param) {
+		param = make_kexdh_param(ses.newkeys->algo_kex);
 	}
-	mp_clear_multi(&dh_g, &dh_p, &dh_q, NULL);
 	return param;
 }
 
@@ -619,7 +708,7 @@ void kexdh_comb_key(struct kex_dh_param *param, mp_int *dh_pub_them,
 	mp_int *dh_e = NULL, *dh_f = NULL;
 
 	m_mp_init_multi(&dh_p, &dh_p_min1, NULL);
-	load_dh_p(&dh_p);
+	load_dh_p(&dh_p, ses.newkeys->algo_kex);
 
 	if (mp_sub_d(&dh_p, 1, &dh_p_min1) != MP_OKAY) { 
 		dropbear_exit("Diffie-Hellman error");
@@ -666,15 +755,23 @@ void kexdh_comb_key(struct kex_dh_param *param, mp_int *dh_pub_them,
 #endif
 
 #if DROPBEAR_ECDH
-struct kex_ecdh_param *gen_kexecdh_param() {
+static struct kex_ecdh_param *make_kexecdh_param(const struct dropbear_kex *algo_kex) {
 	struct kex_ecdh_param *param = m_malloc(sizeof(*param));
 	if (ecc_make_key_ex(NULL, dropbear_ltc_prng, 
-		&param->key, ses.newkeys->algo_kex->ecc_curve->dp) != CRYPT_OK) {
+		&param->key, algo_kex->ecc_curve->dp) != CRYPT_OK) {
 		dropbear_exit("ECC error");
 	}
 	return param;
 }
 
+struct kex_ecdh_param *gen_kexecdh_param() {
+	struct kex_ecdh_param *param = take_spare_param();
+	if (!param) {
+		param = make_kexecdh_param(ses.newkeys->algo_kex);
+	}
+	return param;
+}
+
 void free_kexecdh_param(struct kex_ecdh_param *param) {
 	ecc_free(&param->key);
 	m_free(param);
@@ -721,7 +818,7 @@ void kexecdh_comb_key(struct kex_ecdh_param *param, buffer *pub_them,
 #endif /* DROPBEAR_ECDH */
 
 #if DROPBEAR_CURVE25519
-struct kex_curve25519_param *gen_kexcurve25519_param() {
+static struct kex_curve25519_param *make_kexcurve25519_param() {
 	/* Per http://cr.yp.to/ecdh.html */
 	struct kex_curve25519_param *param = m_malloc(sizeof(*param));
 	const unsigned char basepoint[32] = {9};
@@ -732,6 +829,14 @@ struct kex_curve25519_param *gen_kexcurve25519_param() {
 	return param;
 }
 
+struct kex_curve25519_param *gen_kexcurve25519_param() {
+	struct kex_curve25519_param *param = take_spare_param();
+	if (!param) {
+		param = make_kexcurve25519_param();
+	}
+	return param;
+}
+
 void free_kexcurve25519_param(struct kex_curve25519_param *param) {
 	m_burn(param->priv, CURVE25519_LEN);
 	m_free(param);
@@ -783,6 +888,107 @@ void kexcurve25519_comb_key(const struct kex_curve25519_param *param, const buff
 }
 #endif /* DROPBEAR_CURVE25519 */
 
+/* Make an ephemeral keypair for algo_kex ahead of time, replacing any
+ * other prepared one. */
+void kex_prepare_param(const struct dropbear_kex *algo_kex) {
+	if (spare_param) {
+		if (kex_param_compatible(spare_kex, algo_kex)) {
+			return;
+		}
+		kex_discard_param();
+	}
+
+	switch (algo_kex->mode) {
+#if DROPBEAR_NORMAL_DH
+		case DROPBEAR_KEX_NORMAL_DH:
+			spare_param = make_kexdh_param(algo_kex);
+			break;
+#endif
+#if DROPBEAR_ECDH
+		case DROPBEAR_KEX_ECDH:
+			spare_param = make_kexecdh_param(algo_kex);
+			break;
+#endif
+#if DROPBEAR_CURVE25519
+		case DROPBEAR_KEX_CURVE25519:
+			spare_param = make_kexcurve25519_param();
+			break;
+#endif
+	}
+	spare_kex = algo_kex;
+}
+
+/* Prepare a keypair for the kex method most likely to be negotiated: the
+ * same as last time when rekeying, otherwise our first preference, which
+ * clients usually share. Used by the listener before forking, and by the
+ * server while its KEXINIT is in flight */
+void kex_prepare_likely() {
+	const algo_type *algo = NULL;
+
+#if DROPBEAR_FUZZ
+	if (fuzz.fuzzing && fuzz.skip_kexmaths) {
+		return;
+	}
+#endif
+
+	if (ses.keys && ses.keys->algo_kex) {
+		kex_prepare_param(ses.keys->algo_kex);
+		return;
+	}
+
+	algo = first_usable_algo(sshkex);
+	if (algo && algo->data) {
+		kex_prepare_param((const struct dropbear_kex*)algo->data);
+	}
+}
+
+/* Build the fixed-base tables for the DH groups we offer, so that
+ * sessions forked by the listener share them */
+void kexdh_prepare_tables() {
+#if DROPBEAR_NORMAL_DH
+	const algo_type *algo = NULL;
+	const struct dropbear_kex *algo_kex = NULL;
+	DEF_MP_INT(dh_p);
+
+	m_mp_init(&dh_p);
+	for (algo = sshkex; algo->name; algo++) {
+		algo_kex = (const struct dropbear_kex*)algo->data;
+		if (algo->usable && algo_kex && algo_kex->mode == DROPBEAR_KEX_NORMAL_DH) {
+			load_dh_p(&dh_p, algo_kex);
+			dh_prepare_base_table(algo_kex->dh_p_bytes, &dh_p);
+		}
+	}
+	mp_clear(&dh_p);
+#endif
+}
+
+/* Wipe the prepared keypair, if it hasn't been used */
+void kex_discard_param() {
+	if (!spare_param) {
+		return;
+	}
+
+	switch (spare_kex->mode) {
+#if DROPBEAR_NORMAL_DH
+		case DROPBEAR_KEX_NORMAL_DH:
+			free_kexdh_param(spare_param);
+			break;
+#endif
+#if DROPBEAR_ECDH
+		case DROPBEAR_KEX_ECDH:
+			free_kexecdh_param(spare_param);
+			break;
+#endif
+#if DROPBEAR_CURVE25519
+		case DROPBEAR_KEX_CURVE25519:
+			free_kexcurve25519_param(spare_param);
+			break;
+#endif
+	}
+	spare_param = NULL;
+	spare_kex = NULL;
+}
+
 
 void finish_kexhashbuf(void) {
 	hash_state hs;
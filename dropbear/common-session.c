@@ -35,6 +35,7 @@
 #include "channel.h"
 #include "runopts.h"
 #include "netio.h"
+#include "dbevent.h"
 
 static void checktimeouts(void);
 static long select_timeout(void);
@@ -84,6 +85,7 @@ void common_session_init(int sock_in, int sock_out) {
 	ses.last_packet_time_idle = now;
 	ses.last_packet_time_any_sent = 0;
 	ses.last_packet_time_keepalive_sent = 0;
+	ses.chanbufs_checked = now;
 	
 #if DROPBEAR_FUZZ
 	if (!fuzz.fuzzing)
@@ -97,6 +99,16 @@ void common_session_init(int sock_in, int sock_out) {
 	ses.maxfd = MAX(ses.maxfd, ses.signal_pipe[0]);
 	ses.maxfd = MAX(ses.maxfd, ses.signal_pipe[1]);
 	}
+
+	dbev_init();
+#if DROPBEAR_FUZZ
+	if (!fuzz.fuzzing)
+#endif
+	{
+	/* We get woken up when signal handlers write to this pipe.
+	   SIGCHLD in svr-chansession is the only one currently. */
+	dbev_set(ses.signal_pipe[0], DBEV_READ, DBEV_NO_CHANNEL);
+	}
 	
 	ses.writepayload = buf_new(TRANS_MAX_PAYLOAD_LEN);
 	ses.transseq = 0;
@@ -106,6 +118,7 @@ void common_session_init(int sock_in, int sock_out) {
 	ses.recvseq = 0;
 
 	initqueue(&ses.writequeue);
+	ses.writequeue_limit = WRITEQUEUE_MIN_LIMIT;
 
 	ses.requirenext = SSH_MSG_KEXINIT;
 	ses.dataallowed = 1; /* we can send data until we actually 
@@ -156,35 +169,27 @@ void common_session_init(int sock_in, int sock_out) {
 
 void session_loop(void(*loophandler)(void)) {
 
-	fd_set readfd, writefd;
-	struct timeval timeout;
+	long timeout;
+	unsigned int in_events, out_events;
 	int val;
 
-	/* main loop, select()s for all sockets in use */
+	/* main loop, waits for events on all sockets in use */
 	for(;;) {
-		const int writequeue_has_space = (ses.writequeue_len <= 2*TRANS_MAX_PAYLOAD_LEN);
+		const int writequeue_open = writequeue_has_space();
+		/* Data left over from an earlier read() doesn't need to wait
+		for the socket to become readable again */
+		const int readahead_pending = (ses.sock_in != -1
+			&& packet_readahead_pending() && writequeue_open);
 
-		timeout.tv_sec = select_timeout();
-		timeout.tv_usec = 0;
-		DROPBEAR_FD_ZERO(&writefd);
-		DROPBEAR_FD_ZERO(&readfd);
+		timeout = readahead_pending ? 0 : select_timeout();
 
 		dropbear_assert(ses.payload == NULL);
 
-		/* We get woken up when signal handlers write to this pipe.
-		   SIGCHLD in svr-chansession is the only one currently. */
-#if DROPBEAR_FUZZ
-		if (!fuzz.fuzzing) 
-#endif
-		{
-		FD_SET(ses.signal_pipe[0], &readfd);
-		}
-
-		/* set up for channels which can be read/written */
-		setchannelfds(&readfd, &writefd, writequeue_has_space);
+		/* update channels which can be read/written */
+		setchannelevents(writequeue_open);
 
 		/* Pending connections to test */
-		set_connect_fds(&writefd);
+		set_connect_fds();
 
 		/* We delay reading from the input socket during initial setup until
 		after we have written out our initial KEXINIT packet (empty writequeue). 
@@ -192,42 +197,45 @@ void session_loop(void(*loophandler)(void)) {
 		read for the remote ident.
 		We also avoid reading from the socket if the writequeue is full, that avoids
 		replies backing up */
+		in_events = 0;
 		if (ses.sock_in != -1 
 			&& (ses.remoteident || isempty(&ses.writequeue)) 
-			&& writequeue_has_space) {
-			FD_SET(ses.sock_in, &readfd);
+			&& writequeue_open) {
+			in_events = DBEV_READ;
 		}
 
 		/* Ordering is important, this test must occur after any other function
 		might have queued packets (such as connection handlers) */
+		out_events = 0;
 		if (ses.sock_out != -1 && !isempty(&ses.writequeue)) {
-			FD_SET(ses.sock_out, &writefd);
+			out_events = DBEV_WRITE;
+		}
+
+		if (ses.sock_in == ses.sock_out) {
+			dbev_set(ses.sock_in, in_events | out_events, DBEV_NO_CHANNEL);
+		} else {
+			dbev_set(ses.sock_in, in_events, DBEV_NO_CHANNEL);
+			dbev_set(ses.sock_out, out_events, DBEV_NO_CHANNEL);
 		}
 
-		val = select(ses.maxfd+1, &readfd, &writefd, NULL, &timeout);
+		/* If we were interrupted or the wait timed out, nothing is
+		 * ready. We still want to iterate over channels etc for
+		 * reading, to handle server processes exiting etc. */
+		val = dbev_wait(timeout);
 
 		if (ses.exitflag) {
 			dropbear_exit("Terminated by signal");
 		}
 		
 		if (val < 0 && errno != EINTR) {
-			dropbear_exit("Error in select");
+			dropbear_exit("Error waiting for events");
 		}
 
-		if (val <= 0) {
-			/* If we were interrupted or the select timed out, we still
-			 * want to iterate over channels etc for reading, to handle
-			 * server processes exiting etc. 
-			 * We don't want to read/write FDs. */
-			DROPBEAR_FD_ZERO(&writefd);
-			DROPBEAR_FD_ZERO(&readfd);
-		}
-		
 		/* We'll just empty out the pipe if required. We don't do
 		any thing with the data, since the pipe's purpose is purely to
-		wake up the select() above. */
+		wake up the dbev_wait() above. */
 		ses.channel_signal_pending = 0;
-		if (FD_ISSET(ses.signal_pipe[0], &readfd)) {
+		if (dbev_ready(ses.signal_pipe[0]) & DBEV_READ) {
 			char x;
 			TRACE(("signal pipe set"))
 			while (read(ses.signal_pipe[0], &x, 1) > 0) {}
@@ -239,7 +247,7 @@ void session_loop(void(*loophandler)(void)) {
 
 		/* process session socket's incoming data */
 		if (ses.sock_in != -1) {
-			if (FD_ISSET(ses.sock_in, &readfd)) {
+			if ((dbev_ready(ses.sock_in) & DBEV_READ) || readahead_pending) {
 				if (!ses.remoteident) {
 					/* blocking read of the version string */
 					read_session_identification();
@@ -249,9 +257,16 @@ void session_loop(void(*loophandler)(void)) {
 			}
 			
 			/* Process the decrypted packet. After this, the read buffer
-			 * will be ready for a new packet */
-			if (ses.payload != NULL) {
+			 * will be ready for a new packet. Any further packets that
+			 * arrived in the same read() are handled straight away, unless
+			 * the replies are backing up */
+			while (ses.payload != NULL) {
 				process_packet();
+				if (ses.sock_in == -1 || !packet_readahead_pending()
+					|| ses.writequeue_len > ses.writequeue_limit) {
+					break;
+				}
+				read_packet();
 			}
 		}
 
@@ -259,7 +274,7 @@ void session_loop(void(*loophandler)(void)) {
 		were being held up during a KEX */
 		maybe_flush_reply_queue();
 
-		handle_connect_fds(&writefd);
+		handle_connect_fds();
 
 		/* loop handler prior to channelio, in case the server loophandler closes
 		channels on process exit */
@@ -267,7 +282,7 @@ void session_loop(void(*loophandler)(void)) {
 
 		/* process pipes etc for the channels, ses.dataallowed == 0
 		 * during rekeying ) */
-		channelio(&readfd, &writefd);
+		channelio();
 
 		/* process session socket's outgoing data */
 		if (ses.sock_out != -1) {
@@ -276,6 +291,16 @@ void session_loop(void(*loophandler)(void)) {
 			}
 		}
 
+		/* once our KEXINIT is on the wire, use the round trip to make
+		 * the kex keypair */
+		if (ses.kexstate.prepare_kex && isempty(&ses.writequeue)) {
+			ses.kexstate.prepare_kex = 0;
+			if (!ses.kexstate.recvkexinit
+					&& !(ses.sock_in != -1 && packet_readahead_pending())) {
+				kex_prepare_likely();
+			}
+		}
+
 	} /* for(;;) */
 	
 	/* Not reached */
@@ -301,6 +326,11 @@ void session_cleanup() {
 		return;
 	}
 
+	TRACE(("sent %lu packets in %lu write calls", ses.write_packets, ses.write_calls))
+	TRACE(("received %u packets in %lu read calls", ses.recvseq, ses.read_calls))
+	TRACE(("writequeue filled %lu times, waited %lu ms, limit %u",
+		ses.writequeue_full_count, ses.writequeue_full_ms, ses.writequeue_limit))
+
 	/* BEWARE of changing order of functions here. */
 
 	/* Must be before extra_session_cleanup() */
@@ -318,6 +348,8 @@ void session_cleanup() {
 
 	remove_connect_pending();
 
+	dbev_cleanup();
+
 	while (!isempty(&ses.writequeue)) {
 		buf_free(dequeue(&ses.writequeue));
 	}
@@ -343,10 +375,12 @@ void session_cleanup() {
 	cleanup_buf(&ses.session_id);
 	cleanup_buf(&ses.hash);
 	cleanup_buf(&ses.payload);
+	cleanup_buf(&ses.readahead);
 	cleanup_buf(&ses.readbuf);
 	cleanup_buf(&ses.writepayload);
 	cleanup_buf(&ses.kexhashbuf);
 	cleanup_buf(&ses.transkexinit);
+	packet_buf_cleanup();
 	if (ses.dh_K) {
 		mp_clear(ses.dh_K);
 	}
@@ -570,6 +604,12 @@ static void checktimeouts() {
 			&& now - ses.last_packet_time_idle >= opts.idle_timeout_secs) {
 		dropbear_close("Idle timeout");
 	}
+
+	if (ses.chanbufsheld
+			&& now - ses.chanbufs_checked >= CHANNEL_BUF_IDLE_SECS) {
+		shrinkchannelbufs();
+		ses.chanbufs_checked = now;
+	}
 }
 
 static void update_timeout(long limit, long now, long last_event, long * timeout) {
@@ -605,6 +645,11 @@ static long select_timeout() {
 	update_timeout(opts.idle_timeout_secs, now, ses.last_packet_time_idle,
 		&timeout);
 
+	if (ses.chanbufsheld) {
+		update_timeout(CHANNEL_BUF_IDLE_SECS, now, ses.chanbufs_checked,
+			&timeout);
+	}
+
 	/* clamp negative timeouts to zero - event has already triggered */
 	return MAX(timeout, 0);
 }
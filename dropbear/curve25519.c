@@ -29,7 +29,13 @@
 #if DROPBEAR_CURVE25519 || DROPBEAR_ED25519
 
 /* Modified TweetNaCl version 20140427, a self-contained public-domain C library.
- * https://tweetnacl.cr.yp.to/ */
+ * https://tweetnacl.cr.yp.to/
+ *
+ * The field arithmetic (gf and the functions up to pow2523) replaces
+ * TweetNaCl's sixteen 16-bit limbs. With a 64x64->128 bit multiply it uses
+ * five 51-bit limbs, otherwise ten limbs of alternately 26 and 25 bits with
+ * 32x32->64 bit multiplies, as in ref10. The curve code after it is
+ * TweetNaCl's. */
 
 #define FOR(i,n) for (i = 0;i < n;++i)
 #define sv static void
@@ -38,24 +44,61 @@ typedef unsigned char u8;
 typedef unsigned long u32;
 typedef unsigned long long u64;
 typedef long long i64;
-typedef i64 gf[16];
+
+#ifndef CURVE25519_FE51
+#ifdef __SIZEOF_INT128__
+#define CURVE25519_FE51 1
+#else
+#define CURVE25519_FE51 0
+#endif
+#endif
+
+#if CURVE25519_FE51
+/* Limbs are below 2^51 after a multiply, A() and Z() leave them unreduced
+ * (below 2^54, which M() accepts) */
+typedef u64 limb;
+typedef unsigned __int128 u128;
+#define NLIMB 5
+#define MASK51 0x7ffffffffffffULL
+#else
+/* Signed limbs, every operation carries so that |even limb| <= 2^25 and
+ * |odd limb| <= 2^24 (plus a little for limb 1) */
+typedef int32_t limb;
+#define NLIMB 10
+#endif
+
+typedef limb gf[NLIMB];
 
 #if DROPBEAR_CURVE25519
 static const gf
-  _121665 = {0xDB41,1};
+  _121665 = {121665};
 #endif /* DROPBEAR_CURVE25519 */
 #if DROPBEAR_ED25519
+#if CURVE25519_FE51
+static const gf
+  gf0,
+  gf1 = {1},
+  D2 = {0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff},
+  X = {0x62d608f25d51a, 0x412a4b4f6592a, 0x75b7171a4b31d, 0x1ff60527118fe, 0x216936d3cd6e5},
+  Y = {0x6666666666658, 0x4cccccccccccc, 0x1999999999999, 0x3333333333333, 0x6666666666666};
+#if DROPBEAR_SIGNKEY_VERIFY
+static const gf
+  D = {0x34dca135978a3, 0x1a8283b156ebd, 0x5e7a26001c029, 0x739c663a03cbb, 0x52036cee2b6ff},
+  I = {0x61b274a0ea0b0, 0x0d5a5fc8f189d, 0x7ef5e9cbd0c60, 0x78595a6804c9e, 0x2b8324804fc1d};
+#endif /* DROPBEAR_SIGNKEY_VERIFY */
+#else
 static const gf
   gf0,
   gf1 = {1},
-  D2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406},
-  X = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169},
-  Y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+  D2 = {0x2b2f159, 0x1a6e509, 0x22add7a, 0x0d4141d, 0x0038052, 0x0f3d130, 0x3407977, 0x19ce331, 0x1c56dff, 0x0901b67},
+  X = {0x325d51a, 0x18b5823, 0x0f6592a, 0x104a92d, 0x1a4b31d, 0x1d6dc5c, 0x27118fe, 0x07fd814, 0x13cd6e5, 0x085a4db},
+  Y = {0x2666658, 0x1999999, 0x0cccccc, 0x1333333, 0x1999999, 0x0666666, 0x3333333, 0x0cccccc, 0x2666666, 0x1999999};
 #if DROPBEAR_SIGNKEY_VERIFY
 static const gf
-  D = {0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203},
-  I = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+  D = {0x35978a3, 0x0d37284, 0x3156ebd, 0x06a0a0e, 0x001c029, 0x179e898, 0x3a03cbb, 0x1ce7198, 0x2e2b6ff, 0x1480db3},
+  I = {0x20ea0b0, 0x186c9d2, 0x08f189d, 0x035697f, 0x0bd0c60, 0x1fbd7a7, 0x2804c9e, 0x1e16569, 0x004fc1d, 0x0ae0c92};
 #endif /* DROPBEAR_SIGNKEY_VERIFY */
+#endif /* CURVE25519_FE51 */
 #endif /* DROPBEAR_ED25519 */
 
 #if DROPBEAR_ED25519
@@ -76,134 +119,323 @@ static int crypto_verify_32(const u8 *x,const u8 *y)
 sv set25519(gf r, const gf a)
 {
   int i;
-  FOR(i,16) r[i]=a[i];
+  FOR(i,NLIMB) r[i]=a[i];
 }
 #endif /* DROPBEAR_ED25519 */
 
+sv sel25519(gf p,gf q,int b)
+{
+  limb t,c=(limb)0-(limb)b;
+  int i;
+  FOR(i,NLIMB) {
+    t= c&(p[i]^q[i]);
+    p[i]^=t;
+    q[i]^=t;
+  }
+}
+
+#if CURVE25519_FE51
+
 sv car25519(gf o)
 {
   int i;
-  i64 c;
-  FOR(i,16) {
-    o[i]+=(1LL<<16);
-    c=o[i]>>16;
-    o[(i+1)*(i<15)]+=c-1+37*(c-1)*(i==15);
-    o[i]-=c<<16;
+  FOR(i,4) {
+    o[i+1]+=o[i]>>51;
+    o[i]&=MASK51;
   }
+  o[0]+=19*(o[4]>>51);
+  o[4]&=MASK51;
 }
 
-sv sel25519(gf p,gf q,int b)
+/* carry the 128-bit column sums of a multiply */
+sv car25519_wide(gf o,u128 t[5])
 {
-  i64 t,i,c=~(b-1);
-  FOR(i,16) {
-    t= c&(p[i]^q[i]);
-    p[i]^=t;
-    q[i]^=t;
+  int i;
+  FOR(i,4) {
+    t[i+1]+=(u64)(t[i]>>51);
+    o[i]=(u64)t[i]&MASK51;
   }
+  o[4]=(u64)t[4]&MASK51;
+  o[0]+=19*(u64)(t[4]>>51);
+  o[1]+=o[0]>>51;
+  o[0]&=MASK51;
 }
 
 sv pack25519(u8 *o,const gf n)
 {
-  int i,j,b;
-  gf m,t;
-  FOR(i,16) t[i]=n[i];
+  int i;
+  gf t;
+  u64 w[4];
+  FOR(i,5) t[i]=n[i];
   car25519(t);
   car25519(t);
   car25519(t);
-  FOR(j,2) {
-    m[0]=t[0]-0xffed;
-    for(i=1;i<15;i++) {
-      m[i]=t[i]-0xffff-((m[i-1]>>16)&1);
-      m[i-1]&=0xffff;
-    }
-    m[15]=t[15]-0x7fff-((m[14]>>16)&1);
-    b=(m[15]>>16)&1;
-    m[14]&=0xffff;
-    sel25519(t,m,1-b);
-  }
-  FOR(i,16) {
-    o[2*i]=t[i]&0xff;
-    o[2*i+1]=t[i]>>8;
+  /* 0 <= t < 2^255. Adding 19 and carrying around gives t + 19 - p if
+   * t >= p, adding 2^255 - 19 and dropping bit 255 takes the 19 back off */
+  t[0]+=19;
+  car25519(t);
+  t[0]+=MASK51+1-19;
+  for(i=1;i<5;i++) t[i]+=MASK51;
+  FOR(i,4) {
+    t[i+1]+=t[i]>>51;
+    t[i]&=MASK51;
   }
+  t[4]&=MASK51;
+  w[0]=t[0]|(t[1]<<51);
+  w[1]=(t[1]>>13)|(t[2]<<38);
+  w[2]=(t[2]>>26)|(t[3]<<25);
+  w[3]=(t[3]>>39)|(t[4]<<12);
+  FOR(i,32) o[i]=w[i/8]>>(8*(i%8));
 }
 
-#if DROPBEAR_ED25519
-#if DROPBEAR_SIGNKEY_VERIFY
-static int neq25519(const gf a, const gf b)
+sv unpack25519(gf o, const u8 *n)
 {
-  u8 c[32],d[32];
-  pack25519(c,a);
-  pack25519(d,b);
-  return crypto_verify_32(c,d);
+  int i;
+  u64 w[4] = {0};
+  FOR(i,32) w[i/8]|=(u64)n[i]<<(8*(i%8));
+  o[0]=w[0]&MASK51;
+  o[1]=((w[0]>>51)|(w[1]<<13))&MASK51;
+  o[2]=((w[1]>>38)|(w[2]<<26))&MASK51;
+  o[3]=((w[2]>>25)|(w[3]<<39))&MASK51;
+  o[4]=(w[3]>>12)&MASK51;
 }
-#endif /* DROPBEAR_SIGNKEY_VERIFY */
 
-static u8 par25519(const gf a)
+sv A(gf o,const gf a,const gf b)
 {
-  u8 d[32];
-  pack25519(d,a);
-  return d[0]&1;
+  int i;
+  FOR(i,5) o[i]=a[i]+b[i];
 }
-#endif /* DROPBEAR_ED25519 */
 
-sv unpack25519(gf o, const u8 *n)
+/* adds 4p so that the limbs stay positive */
+sv Z(gf o,const gf a,const gf b)
+{
+  int i;
+  o[0]=a[0]+0x1fffffffffffb4ULL-b[0];
+  for(i=1;i<5;i++) o[i]=a[i]+0x1ffffffffffffcULL-b[i];
+}
+
+sv M(gf o,const gf a,const gf b)
+{
+  u128 t[5];
+  u64 b1=19*b[1],b2=19*b[2],b3=19*b[3],b4=19*b[4];
+  t[0]=(u128)a[0]*b[0]+(u128)a[1]*b4+(u128)a[2]*b3+(u128)a[3]*b2+(u128)a[4]*b1;
+  t[1]=(u128)a[0]*b[1]+(u128)a[1]*b[0]+(u128)a[2]*b4+(u128)a[3]*b3+(u128)a[4]*b2;
+  t[2]=(u128)a[0]*b[2]+(u128)a[1]*b[1]+(u128)a[2]*b[0]+(u128)a[3]*b4+(u128)a[4]*b3;
+  t[3]=(u128)a[0]*b[3]+(u128)a[1]*b[2]+(u128)a[2]*b[1]+(u128)a[3]*b[0]+(u128)a[4]*b4;
+  t[4]=(u128)a[0]*b[4]+(u128)a[1]*b[3]+(u128)a[2]*b[2]+(u128)a[3]*b[1]+(u128)a[4]*b[0];
+  car25519_wide(o,t);
+}
+
+sv S(gf o,const gf a)
+{
+  u128 t[5];
+  u64 d0=2*a[0],d1=2*a[1],d2=38*a[2],d3=19*a[3],d4=19*a[4],d4_2=2*d4;
+  t[0]=(u128)a[0]*a[0]+(u128)d4_2*a[1]+(u128)d2*a[3];
+  t[1]=(u128)d0*a[1]+(u128)d4_2*a[2]+(u128)d3*a[3];
+  t[2]=(u128)d0*a[2]+(u128)a[1]*a[1]+(u128)d4_2*a[3];
+  t[3]=(u128)d0*a[3]+(u128)d1*a[2]+(u128)d4*a[4];
+  t[4]=(u128)d0*a[4]+(u128)d1*a[3]+(u128)a[2]*a[2];
+  car25519_wide(o,t);
+}
+
+#else /* CURVE25519_FE51 */
+
+/* round each limb to nearest into the next one, limb 9 wrapping around
+ * times 19 */
+#define CARRY(i,j,s,m) \
+  c=(t[i]+((i64)1<<((s)-1)))>>(s); \
+  t[j]+=(m)*c; \
+  t[i]-=c*((i64)1<<(s));
+
+sv car25519(gf o,i64 t[10])
 {
+  i64 c;
   int i;
-  FOR(i,16) o[i]=n[2*i]+((i64)n[2*i+1]<<8);
-  o[15]&=0x7fff;
+  CARRY(0,1,26,1) CARRY(1,2,25,1) CARRY(2,3,26,1) CARRY(3,4,25,1) CARRY(4,5,26,1)
+  CARRY(5,6,25,1) CARRY(6,7,26,1) CARRY(7,8,25,1) CARRY(8,9,26,1) CARRY(9,0,25,19)
+  CARRY(0,1,26,1)
+  FOR(i,10) o[i]=(limb)t[i];
+}
+
+sv pack25519(u8 *o,const gf n)
+{
+  i64 t[10],q,c;
+  u64 w=0;
+  int i,j=0,bits=0;
+  FOR(i,10) t[i]=n[i];
+  /* q = floor(n / p), which is -1, 0 or 1 for carried limbs */
+  q=(19*t[9]+((i64)1<<24))>>25;
+  FOR(i,10) q=(t[i]+q)>>(26-(i&1));
+  t[0]+=19*q;
+  /* carry downwards, dropping 2^255 q off the top */
+  FOR(i,10) {
+    c=t[i]>>(26-(i&1));
+    if(i<9) t[i+1]+=c;
+    t[i]-=c*((i64)1<<(26-(i&1)));
+  }
+  FOR(i,10) {
+    w|=(u64)t[i]<<bits;
+    bits+=26-(i&1);
+    while(bits>=8) {
+      o[j++]=w&0xff;
+      w>>=8;
+      bits-=8;
+    }
+  }
+  o[j]=w;
+}
+
+sv unpack25519(gf o, const u8 *n)
+{
+  i64 t[10];
+  u64 w=0;
+  int i,j=0,bits=0;
+  FOR(i,10) {
+    int s=26-(i&1);
+    while(bits<s) {
+      w|=(u64)(j==31?n[j]&127:n[j])<<bits;
+      j++;
+      bits+=8;
+    }
+    t[i]=w&(((u64)1<<s)-1);
+    w>>=s;
+    bits-=s;
+  }
+  car25519(o,t);
 }
 
 sv A(gf o,const gf a,const gf b)
 {
+  i64 t[10];
   int i;
-  FOR(i,16) o[i]=a[i]+b[i];
+  FOR(i,10) t[i]=(i64)a[i]+b[i];
+  car25519(o,t);
 }
 
 sv Z(gf o,const gf a,const gf b)
 {
+  i64 t[10];
   int i;
-  FOR(i,16) o[i]=a[i]-b[i];
+  FOR(i,10) t[i]=(i64)a[i]-b[i];
+  car25519(o,t);
 }
 
 sv M(gf o,const gf a,const gf b)
 {
-  i64 i,j,t[31];
-  FOR(i,31) t[i]=0;
-  FOR(i,16) FOR(j,16) t[i+j]+=a[i]*b[j];
-  FOR(i,15) t[i]+=38*t[i+16];
-  FOR(i,16) o[i]=t[i];
-  car25519(o);
-  car25519(o);
+  limb a2[10],b19[10];
+  i64 t[10];
+  int i;
+  FOR(i,10) {
+    a2[i]=2*a[i];
+    b19[i]=19*b[i];
+  }
+  t[0]=a[0]*(i64)b[0]+a2[1]*(i64)b19[9]+a[2]*(i64)b19[8]+a2[3]*(i64)b19[7]+a[4]*(i64)b19[6]+a2[5]*(i64)b19[5]+a[6]*(i64)b19[4]+a2[7]*(i64)b19[3]+a[8]*(i64)b19[2]+a2[9]*(i64)b19[1];
+  t[1]=a[0]*(i64)b[1]+a[1]*(i64)b[0]+a[2]*(i64)b19[9]+a[3]*(i64)b19[8]+a[4]*(i64)b19[7]+a[5]*(i64)b19[6]+a[6]*(i64)b19[5]+a[7]*(i64)b19[4]+a[8]*(i64)b19[3]+a[9]*(i64)b19[2];
+  t[2]=a[0]*(i64)b[2]+a2[1]*(i64)b[1]+a[2]*(i64)b[0]+a2[3]*(i64)b19[9]+a[4]*(i64)b19[8]+a2[5]*(i64)b19[7]+a[6]*(i64)b19[6]+a2[7]*(i64)b19[5]+a[8]*(i64)b19[4]+a2[9]*(i64)b19[3];
+  t[3]=a[0]*(i64)b[3]+a[1]*(i64)b[2]+a[2]*(i64)b[1]+a[3]*(i64)b[0]+a[4]*(i64)b19[9]+a[5]*(i64)b19[8]+a[6]*(i64)b19[7]+a[7]*(i64)b19[6]+a[8]*(i64)b19[5]+a[9]*(i64)b19[4];
+  t[4]=a[0]*(i64)b[4]+a2[1]*(i64)b[3]+a[2]*(i64)b[2]+a2[3]*(i64)b[1]+a[4]*(i64)b[0]+a2[5]*(i64)b19[9]+a[6]*(i64)b19[8]+a2[7]*(i64)b19[7]+a[8]*(i64)b19[6]+a2[9]*(i64)b19[5];
+  t[5]=a[0]*(i64)b[5]+a[1]*(i64)b[4]+a[2]*(i64)b[3]+a[3]*(i64)b[2]+a[4]*(i64)b[1]+a[5]*(i64)b[0]+a[6]*(i64)b19[9]+a[7]*(i64)b19[8]+a[8]*(i64)b19[7]+a[9]*(i64)b19[6];
+  t[6]=a[0]*(i64)b[6]+a2[1]*(i64)b[5]+a[2]*(i64)b[4]+a2[3]*(i64)b[3]+a[4]*(i64)b[2]+a2[5]*(i64)b[1]+a[6]*(i64)b[0]+a2[7]*(i64)b19[9]+a[8]*(i64)b19[8]+a2[9]*(i64)b19[7];
+  t[7]=a[0]*(i64)b[7]+a[1]*(i64)b[6]+a[2]*(i64)b[5]+a[3]*(i64)b[4]+a[4]*(i64)b[3]+a[5]*(i64)b[2]+a[6]*(i64)b[1]+a[7]*(i64)b[0]+a[8]*(i64)b19[9]+a[9]*(i64)b19[8];
+  t[8]=a[0]*(i64)b[8]+a2[1]*(i64)b[7]+a[2]*(i64)b[6]+a2[3]*(i64)b[5]+a[4]*(i64)b[4]+a2[5]*(i64)b[3]+a[6]*(i64)b[2]+a2[7]*(i64)b[1]+a[8]*(i64)b[0]+a2[9]*(i64)b19[9];
+  t[9]=a[0]*(i64)b[9]+a[1]*(i64)b[8]+a[2]*(i64)b[7]+a[3]*(i64)b[6]+a[4]*(i64)b[5]+a[5]*(i64)b[4]+a[6]*(i64)b[3]+a[7]*(i64)b[2]+a[8]*(i64)b[1]+a[9]*(i64)b[0];
+  car25519(o,t);
 }
 
 sv S(gf o,const gf a)
 {
-  M(o,a,a);
+  limb a2[10],a19[10],a38[10];
+  i64 t[10];
+  int i;
+  FOR(i,10) {
+    a2[i]=2*a[i];
+    a19[i]=19*a[i];
+    a38[i]=(i&1)?38*a[i]:0; /* only the odd ones fit */
+  }
+  t[0]=a[0]*(i64)a[0]+a2[1]*(i64)a38[9]+a2[2]*(i64)a19[8]+a2[3]*(i64)a38[7]+a2[4]*(i64)a19[6]+a[5]*(i64)a38[5];
+  t[1]=a[0]*(i64)a2[1]+a[2]*(i64)a38[9]+a2[3]*(i64)a19[8]+a[4]*(i64)a38[7]+a2[5]*(i64)a19[6];
+  t[2]=a[0]*(i64)a2[2]+a[1]*(i64)a2[1]+a2[3]*(i64)a38[9]+a2[4]*(i64)a19[8]+a2[5]*(i64)a38[7]+a[6]*(i64)a19[6];
+  t[3]=a[0]*(i64)a2[3]+a[1]*(i64)a2[2]+a[4]*(i64)a38[9]+a2[5]*(i64)a19[8]+a[6]*(i64)a38[7];
+  t[4]=a[0]*(i64)a2[4]+a2[1]*(i64)a2[3]+a[2]*(i64)a[2]+a2[5]*(i64)a38[9]+a2[6]*(i64)a19[8]+a[7]*(i64)a38[7];
+  t[5]=a[0]*(i64)a2[5]+a[1]*(i64)a2[4]+a[2]*(i64)a2[3]+a[6]*(i64)a38[9]+a2[7]*(i64)a19[8];
+  t[6]=a[0]*(i64)a2[6]+a2[1]*(i64)a2[5]+a[2]*(i64)a2[4]+a[3]*(i64)a2[3]+a2[7]*(i64)a38[9]+a[8]*(i64)a19[8];
+  t[7]=a[0]*(i64)a2[7]+a[1]*(i64)a2[6]+a[2]*(i64)a2[5]+a[3]*(i64)a2[4]+a[8]*(i64)a38[9];
+  t[8]=a[0]*(i64)a2[8]+a2[1]*(i64)a2[7]+a[2]*(i64)a2[6]+a2[3]*(i64)a2[5]+a[4]*(i64)a[4]+a[9]*(i64)a38[9];
+  t[9]=a[0]*(i64)a2[9]+a[1]*(i64)a2[8]+a[2]*(i64)a2[7]+a[3]*(i64)a2[6]+a[4]*(i64)a2[5];
+  car25519(o,t);
+}
+
+#endif /* CURVE25519_FE51 */
+
+#if DROPBEAR_ED25519
+#if DROPBEAR_SIGNKEY_VERIFY
+static int neq25519(const gf a, const gf b)
+{
+  u8 c[32],d[32];
+  pack25519(c,a);
+  pack25519(d,b);
+  return crypto_verify_32(c,d);
+}
+#endif /* DROPBEAR_SIGNKEY_VERIFY */
+
+static u8 par25519(const gf a)
+{
+  u8 d[32];
+  pack25519(d,a);
+  return d[0]&1;
+}
+#endif /* DROPBEAR_ED25519 */
+
+/* o = i^(2^n) */
+sv sqn25519(gf o,const gf i,int n)
+{
+  S(o,i);
+  while(--n > 0) S(o,o);
+}
+
+/* the ref10 addition chains: 254 squarings and 11 multiplies for the
+ * inverse i^(p-2), rather than one multiply per bit */
+sv chain25519(gf z11,gf z2_250_0,const gf i)
+{
+  gf z2,z9,t,z2_5_0,z2_10_0,z2_20_0,z2_50_0,z2_100_0;
+  S(z2,i);
+  sqn25519(t,z2,2);
+  M(z9,t,i);
+  M(z11,z9,z2);
+  S(t,z11);
+  M(z2_5_0,t,z9);
+  sqn25519(t,z2_5_0,5);
+  M(z2_10_0,t,z2_5_0);
+  sqn25519(t,z2_10_0,10);
+  M(z2_20_0,t,z2_10_0);
+  sqn25519(t,z2_20_0,20);
+  M(t,t,z2_20_0);
+  sqn25519(t,t,10);
+  M(z2_50_0,t,z2_10_0);
+  sqn25519(t,z2_50_0,50);
+  M(z2_100_0,t,z2_50_0);
+  sqn25519(t,z2_100_0,100);
+  M(t,t,z2_100_0);
+  sqn25519(t,t,50);
+  M(z2_250_0,t,z2_50_0);
 }
 
 sv inv25519(gf o,const gf i)
 {
-  gf c;
-  int a;
-  FOR(a,16) c[a]=i[a];
-  for(a=253;a>=0;a--) {
-    S(c,c);
-    if(a!=2&&a!=4) M(c,c,i);
-  }
-  FOR(a,16) o[a]=c[a];
+  gf z11,t;
+  chain25519(z11,t,i);
+  sqn25519(t,t,5);
+  M(o,t,z11);
 }
 
 #if DROPBEAR_ED25519 && DROPBEAR_SIGNKEY_VERIFY
+/* i^((p-5)/8) */
 sv pow2523(gf o,const gf i)
 {
-  gf c;
-  int a;
-  FOR(a,16) c[a]=i[a];
-  for(a=250;a>=0;a--) {
-    S(c,c);
-    if(a!=1) M(c,c,i);
-  }
-  FOR(a,16) o[a]=c[a];
+  gf z11,t;
+  chain25519(z11,t,i);
+  sqn25519(t,t,2);
+  M(o,t,i);
 }
 #endif /* DROPBEAR_ED25519 && DROPBEAR_SIGNKEY_VERIFY */
 
@@ -211,17 +443,18 @@ sv pow2523(gf o,const gf i)
 void dropbear_curve25519_scalarmult(u8 *q,const u8 *n,const u8 *p)
 {
   u8 z[32];
-  i64 x[80],r,i;
-  gf a,b,c,d,e,f;
+  int r,i;
+  gf x,a,b,c,d,e,f;
   FOR(i,31) z[i]=n[i];
   z[31]=(n[31]&127)|64;
   z[0]&=248;
   unpack25519(x,p);
-  FOR(i,16) {
+  FOR(i,NLIMB) {
     b[i]=x[i];
     d[i]=a[i]=c[i]=0;
   }
   a[0]=d[0]=1;
+  /* Montgomery ladder */
   for(i=254;i>=0;--i) {
     r=(z[i>>3]>>(i&7))&1;
     sel25519(a,b,r);
@@ -247,15 +480,9 @@ void dropbear_curve25519_scalarmult(u8 *q,const u8 *n,const u8 *p)
     sel25519(a,b,r);
     sel25519(c,d,r);
   }
-  FOR(i,16) {
-    x[i+16]=a[i];
-    x[i+32]=c[i];
-    x[i+48]=b[i];
-    x[i+64]=d[i];
-  }
-  inv25519(x+32,x+32);
-  M(x+16,x+16,x+32);
-  pack25519(q,x+16);
+  inv25519(c,c);
+  M(a,a,c);
+  pack25519(q,a);
 }
 #endif /* DROPBEAR_CURVE25519 */
 
@@ -327,14 +554,137 @@ sv scalarmult(gf p[4],gf q[4],const u8 *s)
   }
 }
 
-sv scalarbase(gf p[4],const u8 *s)
+/* Fixed-base multiples for scalarbase(), as in ref10: base_table[i][j] is
+ * (j+1) 256^i B in precomputed affine form (y+x, y-x, 2dxy). The table is
+ * 30kB, built on first use or by dropbear_ed25519_precompute() before the
+ * server forks. */
+static gf base_table[32][8][3];
+static int base_table_done = 0;
+
+sv cmov25519(gf p,const gf q,int b)
 {
-  gf q[4];
+  limb c=(limb)0-(limb)b;
+  int i;
+  FOR(i,NLIMB) p[i]^=c&(p[i]^q[i]);
+}
+
+/* p += q, for q from base_table */
+sv madd(gf p[4],gf q[3])
+{
+  gf a,b,c,d,e,f,g,h;
+
+  Z(a, p[1], p[0]);
+  M(a, a, q[1]);
+  A(b, p[0], p[1]);
+  M(b, b, q[0]);
+  M(c, p[3], q[2]);
+  A(d, p[2], p[2]);
+  Z(e, b, a);
+  Z(f, d, c);
+  A(g, d, c);
+  A(h, b, a);
+
+  M(p[0], e, f);
+  M(p[1], h, g);
+  M(p[2], g, f);
+  M(p[3], e, h);
+}
+
+void dropbear_ed25519_precompute(void)
+{
+  gf p[4],q[4],zi,x,y;
+  int i,j,k;
+
+  if (base_table_done) return;
+
   set25519(q[0],X);
   set25519(q[1],Y);
   set25519(q[2],gf1);
   M(q[3],X,Y);
-  scalarmult(p,q,s);
+  FOR(i,32) {
+    FOR(k,4) set25519(p[k],q[k]);
+    FOR(j,8) {
+      if (j) add(p,q);
+      inv25519(zi,p[2]);
+      M(x,p[0],zi);
+      M(y,p[1],zi);
+      A(base_table[i][j][0],y,x);
+      Z(base_table[i][j][1],y,x);
+      M(x,x,y);
+      M(base_table[i][j][2],x,D2);
+    }
+    FOR(k,8) add(q,q);
+  }
+  base_table_done = 1;
+}
+
+/* constant time lookup of d 256^pos B, -8 <= d <= 8 */
+sv selbase(gf n[3],int pos,signed char d)
+{
+  gf t;
+  u8 neg = ((u8)d)>>7;
+  u8 a = d - ((-neg & d) << 1);
+  int j,k;
+
+  set25519(n[0],gf1);
+  set25519(n[1],gf1);
+  set25519(n[2],gf0);
+  FOR(j,8) {
+    int eq = ((a ^ (j + 1)) - 1U) >> 31;
+    FOR(k,3) cmov25519(n[k],base_table[pos][j][k],eq);
+  }
+  set25519(t,n[0]);
+  cmov25519(n[0],n[1],neg);
+  cmov25519(n[1],t,neg);
+  Z(t,gf0,n[2]);
+  cmov25519(n[2],t,neg);
+}
+
+sv scalarbase(gf p[4],const u8 *s)
+{
+  gf q[4];
+  signed char e[64],carry;
+  int i;
+
+  if (s[31] > 127) {
+    /* only an unreduced S from a signature being verified */
+    set25519(q[0],X);
+    set25519(q[1],Y);
+    set25519(q[2],gf1);
+    M(q[3],X,Y);
+    scalarmult(p,q,s);
+    return;
+  }
+
+  dropbear_ed25519_precompute();
+
+  /* signed radix 16 digits, -8 <= e[i] <= 7 (e[63] <= 8) */
+  FOR(i,32) {
+    e[2*i] = s[i] & 15;
+    e[2*i+1] = s[i] >> 4;
+  }
+  carry = 0;
+  FOR(i,63) {
+    e[i] += carry;
+    carry = (e[i] + 8) >> 4;
+    e[i] -= carry * 16;
+  }
+  e[63] += carry;
+
+  set25519(p[0],gf0);
+  set25519(p[1],gf1);
+  set25519(p[2],gf1);
+  set25519(p[3],gf0);
+  /* sum of the odd digits times 16, then the even ones */
+  for (i = 1;i < 64;i += 2) {
+    selbase(q,i/2,e[i]);
+    madd(p,q);
+  }
+  FOR(i,4) add(p,p);
+  for (i = 0;i < 64;i += 2) {
+    selbase(q,i/2,e[i]);
+    madd(p,q);
+  }
 }
 
 void dropbear_ed25519_make_key(u8 *pk,u8 *sk)
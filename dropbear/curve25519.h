@@ -26,6 +26,7 @@
 #define DROPBEAR_CURVE25519_H
 
 void dropbear_curve25519_scalarmult(unsigned char *q, const unsigned char *n, const unsigned char *p);
+void dropbear_ed25519_precompute(void);
 void dropbear_ed25519_make_key(unsigned char *pk, unsigned char  *sk);
 void dropbear_ed25519_sign(const unsigned char *m, unsigned long mlen,
 			  unsigned char *s, unsigned long *slen,
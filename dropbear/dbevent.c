@@ -0,0 +1,381 @@
+/*
+ * Dropbear SSH
+ *
+ * Copyright (c) 2002,2003 Matt Johnston
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. */
+
+#include "includes.h"
+#include "dbevent.h"
+#include "dbutil.h"
+#include "session.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/* the most fds handled per wakeup, the rest stay ready for the next */
+#define DBEV_MAX_READY 64
+
+struct dbev_fd {
+	unsigned char events; /* registered */
+	unsigned char ready; /* from the last dbev_wait() */
+	unsigned char always; /* a regular file, epoll can't wait on it */
+	int chan;
+	int slot; /* index in pollfds */
+};
+
+struct dbev_readyfd {
+	int fd;
+	int chan;
+};
+
+static struct dbev_fd *fds = NULL;
+static int fdsize = 0;
+
+static struct dbev_readyfd readyfds[DBEV_MAX_READY];
+static unsigned int nready = 0;
+
+/* poll() backend */
+static struct pollfd *pollfds = NULL;
+static unsigned int npollfds = 0, pollsize = 0;
+static unsigned int pollstart = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+static int epfd = -1;
+static unsigned int nalways = 0;
+#endif
+
+static struct dbev_fd* getfd(int fd) {
+	int i, newsize;
+
+	if (fd >= fdsize) {
+		newsize = MAX(fd + 1, MAX(fdsize * 2, 64));
+		fds = m_realloc(fds, newsize * sizeof(*fds));
+		for (i = fdsize; i < newsize; i++) {
+			fds[i].events = fds[i].ready = fds[i].always = 0;
+			fds[i].chan = DBEV_NO_CHANNEL;
+			fds[i].slot = -1;
+		}
+		fdsize = newsize;
+	}
+	return &fds[fd];
+}
+
+void dbev_init() {
+
+	dbev_cleanup();
+
+#ifdef HAVE_SYS_EPOLL_H
+#if DROPBEAR_FUZZ
+	/* wrapped fds only work with poll() */
+	if (!fuzz.fuzzing)
+#endif
+	{
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		TRACE(("epoll_create1 failed, using poll: %s", strerror(errno)))
+	} else {
+		ses.maxfd = MAX(ses.maxfd, epfd);
+	}
+	}
+#endif
+}
+
+void dbev_cleanup() {
+
+#ifdef HAVE_SYS_EPOLL_H
+	m_close(epfd);
+	epfd = -1;
+	nalways = 0;
+#endif
+	m_free(fds);
+	fdsize = 0;
+	m_free(pollfds);
+	npollfds = pollsize = 0;
+	nready = 0;
+}
+
+static void poll_set(struct dbev_fd *e, int fd, unsigned int events) {
+
+	short pevents = 0;
+
+	if (events & DBEV_READ) {
+		pevents |= POLLIN;
+	}
+	if (events & DBEV_WRITE) {
+		pevents |= POLLOUT;
+	}
+
+	if (events == 0) {
+		/* move the last one into the slot */
+		if (e->slot >= 0) {
+			npollfds--;
+			if ((unsigned int)e->slot != npollfds) {
+				pollfds[e->slot] = pollfds[npollfds];
+				fds[pollfds[e->slot].fd].slot = e->slot;
+			}
+			e->slot = -1;
+		}
+		return;
+	}
+
+	if (e->slot < 0) {
+		if (npollfds == pollsize) {
+			pollsize = MAX(pollsize * 2, 16);
+			pollfds = m_realloc(pollfds, pollsize * sizeof(*pollfds));
+		}
+		e->slot = npollfds++;
+		pollfds[e->slot].fd = fd;
+		pollfds[e->slot].revents = 0;
+	}
+	pollfds[e->slot].events = pevents;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void epoll_set(struct dbev_fd *e, int fd, unsigned int events) {
+
+	struct epoll_event ev;
+	int op, res;
+
+	if (e->always) {
+		if (events == 0) {
+			e->always = 0;
+			nalways--;
+		}
+		return;
+	}
+
+	memset(&ev, 0x0, sizeof(ev));
+	if (events & DBEV_READ) {
+		ev.events |= EPOLLIN;
+	}
+	if (events & DBEV_WRITE) {
+		ev.events |= EPOLLOUT;
+	}
+	ev.data.fd = fd;
+
+	if (e->events == 0) {
+		op = EPOLL_CTL_ADD;
+	} else if (events == 0) {
+		op = EPOLL_CTL_DEL;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	res = epoll_ctl(epfd, op, fd, &ev);
+	if (res < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+		res = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+	} else if (res < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+		res = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	}
+	if (res < 0) {
+		if (op == EPOLL_CTL_DEL) {
+			return;
+		}
+		if (errno == EPERM) {
+			/* regular files are always ready, as with select() */
+			e->always = 1;
+			nalways++;
+			return;
+		}
+		dropbear_exit("Error in epoll_ctl: %s", strerror(errno));
+	}
+}
+#endif
+
+void dbev_set(int fd, unsigned int events, int chan) {
+
+	struct dbev_fd *e;
+
+	if (fd < 0) {
+		return;
+	}
+
+	e = getfd(fd);
+	e->chan = chan;
+	if (e->events == events) {
+		return;
+	}
+
+	TRACE2(("dbev_set fd %d events %d chan %d", fd, events, chan))
+#ifdef HAVE_SYS_EPOLL_H
+	if (epfd >= 0) {
+		epoll_set(e, fd, events);
+	} else
+#endif
+	{
+		poll_set(e, fd, events);
+	}
+	e->events = events;
+}
+
+void dbev_forget(int fd) {
+
+	if (fd < 0 || fd >= fdsize) {
+		return;
+	}
+	dbev_set(fd, 0, DBEV_NO_CHANNEL);
+	fds[fd].ready = 0;
+}
+
+int dbev_owner(int fd) {
+	if (fd < 0 || fd >= fdsize) {
+		return DBEV_NO_CHANNEL;
+	}
+	return fds[fd].chan;
+}
+
+static void add_ready(int fd, unsigned int ready) {
+
+	struct dbev_fd *e = &fds[fd];
+
+	/* errors and hangups are reported as whatever was asked for,
+	 * the following read() or write() picks them up */
+	ready &= e->events;
+	if (ready && nready < DBEV_MAX_READY) {
+		e->ready = ready;
+		readyfds[nready].fd = fd;
+		readyfds[nready].chan = e->chan;
+		nready++;
+	}
+}
+
+static int poll_wait(int timeout_ms) {
+
+	unsigned int i, n;
+	unsigned int ready;
+	int val;
+
+	val = poll(pollfds, npollfds, timeout_ms);
+	if (val <= 0) {
+		return val;
+	}
+
+	/* start somewhere different each time so that with more than
+	 * DBEV_MAX_READY ready fds none of them are starved */
+	for (n = 0; n < npollfds && nready < DBEV_MAX_READY; n++) {
+		i = (pollstart + n) % npollfds;
+		if (pollfds[i].revents == 0) {
+			continue;
+		}
+		ready = 0;
+		if (pollfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			ready = DBEV_READ | DBEV_WRITE;
+		}
+		if (pollfds[i].revents & POLLIN) {
+			ready |= DBEV_READ;
+		}
+		if (pollfds[i].revents & POLLOUT) {
+			ready |= DBEV_WRITE;
+		}
+		add_ready(pollfds[i].fd, ready);
+	}
+	pollstart++;
+
+	return nready;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_wait_events(int timeout_ms) {
+
+	struct epoll_event events[DBEV_MAX_READY];
+	unsigned int ready;
+	int i, fd, val;
+
+	if (nalways > 0) {
+		timeout_ms = 0;
+	}
+
+	val = epoll_wait(epfd, events, DBEV_MAX_READY, timeout_ms);
+	if (val < 0) {
+		return val;
+	}
+
+	for (i = 0; i < val; i++) {
+		ready = 0;
+		if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+			ready = DBEV_READ | DBEV_WRITE;
+		}
+		if (events[i].events & EPOLLIN) {
+			ready |= DBEV_READ;
+		}
+		if (events[i].events & EPOLLOUT) {
+			ready |= DBEV_WRITE;
+		}
+		add_ready(events[i].data.fd, ready);
+	}
+
+	if (nalways > 0) {
+		for (fd = 0; fd < fdsize; fd++) {
+			if (fds[fd].always) {
+				add_ready(fd, fds[fd].events);
+			}
+		}
+	}
+
+	return nready;
+}
+#endif
+
+int dbev_wait(long timeout) {
+
+	unsigned int i;
+	int timeout_ms;
+
+	for (i = 0; i < nready; i++) {
+		fds[readyfds[i].fd].ready = 0;
+	}
+	nready = 0;
+
+	if (timeout > INT_MAX / 1000) {
+		timeout = INT_MAX / 1000;
+	}
+	timeout_ms = timeout * 1000;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (epfd >= 0) {
+		return epoll_wait_events(timeout_ms);
+	}
+#endif
+	return poll_wait(timeout_ms);
+}
+
+unsigned int dbev_ready(int fd) {
+	if (fd < 0 || fd >= fdsize) {
+		return 0;
+	}
+	return fds[fd].ready;
+}
+
+/* Clear the ready events of fd, once they've been handled */
+void dbev_consume(int fd) {
+	if (fd >= 0 && fd < fdsize) {
+		fds[fd].ready = 0;
+	}
+}
+
+unsigned int dbev_ready_count() {
+	return nready;
+}
+
+int dbev_ready_chan(unsigned int i) {
+	return readyfds[i].chan;
+}
@@ -0,0 +1,60 @@
+/*
+ * Dropbear SSH
+ *
+ * Copyright (c) 2002,2003 Matt Johnston
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. */
+
+#ifndef DROPBEAR_DBEVENT_H_
+#define DROPBEAR_DBEVENT_H_
+
+#include "includes.h"
+
+/* The fds session_loop() waits on. Interest is kept between iterations
+ * and only changed when it differs, so the cost of a wakeup depends on
+ * the number of ready fds rather than the number registered.
+ * Uses epoll where available, otherwise poll(). */
+
+#define DBEV_READ 1
+#define DBEV_WRITE 2
+
+/* owner of fds that don't belong to a channel */
+#define DBEV_NO_CHANNEL (-1)
+
+void dbev_init(void);
+void dbev_cleanup(void);
+
+/* Set the events to wait for on fd, 0 for none. chan is the index of the
+ * channel the fd belongs to, returned by dbev_ready_chan() */
+void dbev_set(int fd, unsigned int events, int chan);
+/* Must be called before closing a registered fd */
+void dbev_forget(int fd);
+int dbev_owner(int fd);
+
+/* Wait for events, timeout is in seconds. Returns the number of ready
+ * fds, or -1 with errno set */
+int dbev_wait(long timeout);
+/* The events that were ready for fd in the last dbev_wait() */
+unsigned int dbev_ready(int fd);
+void dbev_consume(int fd);
+unsigned int dbev_ready_count(void);
+int dbev_ready_chan(unsigned int i);
+
+#endif /* DROPBEAR_DBEVENT_H_ */
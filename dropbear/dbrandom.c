@@ -39,16 +39,38 @@ static int donerandinit = 0;
 
 #define INIT_SEED_SIZE 32 /* 256 bits */
 
+/* ChaCha20 output buffer, a multiple of the 64 byte block size */
+#define RNG_KEY_SIZE 32
+#define RNG_BUF_SIZE 1024
+
+static unsigned char rng_key[RNG_KEY_SIZE];
+static unsigned char rng_buf[RNG_BUF_SIZE];
+/* unread bytes, at the end of rng_buf */
+static unsigned int rng_avail = 0;
+static int rng_keyed = 0;
+
 /* The basic setup is we read some data from /dev/(u)random or prngd and hash it
- * into hashpool. To read data, we hash together current hashpool contents,
- * and a counter. We feed more data in by hashing the current pool and new
+ * into hashpool. We feed more data in by hashing the current pool and new
  * data into the pool.
  *
+ * To read data, we hash together current hashpool contents and a counter
+ * to get a ChaCha20 key. Its keystream fills rng_buf, and the first 32
+ * bytes of each fill replace the key ("fast key erasure"), so earlier
+ * output can't be recovered from the state. Bytes are wiped from rng_buf
+ * as they're handed out. Changing the pool starts a new key, so the
+ * addrandom() after fork() gives the parent and child separate streams.
+ *
  * It is important to ensure that counter doesn't wrap around before we
  * feed in new entropy.
  *
  */
 
+static void rng_reset(void) {
+	m_burn(rng_buf + RNG_BUF_SIZE - rng_avail, rng_avail);
+	rng_avail = 0;
+	rng_keyed = 0;
+}
+
 /* Pass wantlen=0 to hash an entire file */
 static int
 process_file(hash_state *hs, const char *filename,
@@ -158,6 +180,8 @@ void addrandom(const unsigned char * buf, unsigned int len)
 	/* new */
 	sha1_process(&hs, buf, len);
 	sha1_done(&hs, hashpool);
+
+	rng_reset();
 }
 
 static void write_urandom()
@@ -189,6 +213,7 @@ void fuzz_seed(void) {
 
 	counter = 0;
 	donerandinit = 1;
+	rng_reset();
 }
 #endif
 
@@ -338,17 +363,60 @@ void seedrandom() {
 
 	counter = 0;
 	donerandinit = 1;
+	rng_reset();
 
 	/* Feed it all back into /dev/urandom - this might help if Dropbear
 	 * is running from inetd and gets new state each time */
 	write_urandom();
 }
 
-/* return len bytes of pseudo-random data */
-void genrandom(unsigned char* buf, unsigned int len) {
+/* new ChaCha20 key from hashpool */
+static void rng_rekey(void) {
 
 	hash_state hs;
 	unsigned char hash[SHA1_HASH_SIZE];
+	unsigned int pos;
+
+	for (pos = 0; pos < RNG_KEY_SIZE; pos += SHA1_HASH_SIZE) {
+		sha1_init(&hs);
+		sha1_process(&hs, (void*)hashpool, sizeof(hashpool));
+		sha1_process(&hs, (void*)&counter, sizeof(counter));
+		sha1_done(&hs, hash);
+		counter++;
+
+		memcpy(&rng_key[pos], hash, MIN(SHA1_HASH_SIZE, RNG_KEY_SIZE - pos));
+	}
+	m_burn(hash, sizeof(hash));
+	rng_keyed = 1;
+}
+
+static void rng_refill(void) {
+
+	chacha_state st;
+	const unsigned char iv[8] = {0};
+
+	counter++;
+	if (counter > MAX_COUNTER) {
+		seedrandom();
+	}
+	if (!rng_keyed) {
+		rng_rekey();
+	}
+
+	if (chacha_setup(&st, rng_key, RNG_KEY_SIZE, 20) != CRYPT_OK
+		|| chacha_ivctr64(&st, iv, sizeof(iv), 0) != CRYPT_OK
+		|| chacha_keystream(&st, rng_key, RNG_KEY_SIZE) != CRYPT_OK
+		|| chacha_keystream(&st, rng_buf, RNG_BUF_SIZE) != CRYPT_OK) {
+		dropbear_exit("genrandom failed");
+	}
+	m_burn(&st, sizeof(st));
+	rng_avail = RNG_BUF_SIZE;
+}
+
+/* return len bytes of pseudo-random data */
+void genrandom(unsigned char* buf, unsigned int len) {
+
+	unsigned char *src;
 	unsigned int copylen;
 
 	if (!donerandinit) {
@@ -356,22 +424,18 @@ void genrandom(unsigned char* buf, unsigned int len) {
 	}
 
 	while (len > 0) {
-		sha1_init(&hs);
-		sha1_process(&hs, (void*)hashpool, sizeof(hashpool));
-		sha1_process(&hs, (void*)&counter, sizeof(counter));
-		sha1_done(&hs, hash);
-
-		counter++;
-		if (counter > MAX_COUNTER) {
-			seedrandom();
+		if (rng_avail == 0) {
+			rng_refill();
 		}
 
-		copylen = MIN(len, SHA1_HASH_SIZE);
-		memcpy(buf, hash, copylen);
+		copylen = MIN(len, rng_avail);
+		src = &rng_buf[RNG_BUF_SIZE - rng_avail];
+		memcpy(buf, src, copylen);
+		m_burn(src, copylen);
+		rng_avail -= copylen;
 		len -= copylen;
 		buf += copylen;
 	}
-	m_burn(hash, sizeof(hash));
 }
 
 /* Generates a random mp_int. 
@@ -114,6 +114,17 @@ IMPORTANT: Some options will require "make clean" after changes */
 #define DROPBEAR_SHA2_256_HMAC 1
 #define DROPBEAR_SHA1_96_HMAC 0
 
+/* Also offer encrypt-then-MAC variants (*-etm@openssh.com) of the enabled
+ * HMACs. OpenSSH prefers these, and a corrupt packet is rejected before
+ * any of it is decrypted. Recommended. */
+#define DROPBEAR_ENABLE_ETM_MODE 1
+
+/* UMAC encrypt-then-MAC modes (umac-64-etm@openssh.com and
+ * umac-128-etm@openssh.com). These take much less CPU per byte than the
+ * HMACs so are worthwhile on slow devices doing bulk transfers.
+ * Requires AES and DROPBEAR_ENABLE_ETM_MODE */
+#define DROPBEAR_UMAC_ETM 1
+
 /* Hostkey/public key algorithms - at least one required, these are used
  * for hostkey as well as for verifying signatures with pubkey auth.
  * Removing either of these won't save very much space.
@@ -184,6 +195,13 @@ group1 in Dropbear server too */
  * interoperability) */
 #define DROPBEAR_ZLIB_WINDOW_BITS 15 
 
+/* zlib level used for outgoing data, 0-9. Data that doesn't compress is
+ * sent as stored blocks instead, and tried again after DEFAULT_COMPRESS_PROBE
+ * kB (0 always compresses). Both can be changed at runtime with
+ * -Z level[,probe] */
+#define DEFAULT_COMPRESS_LEVEL 6
+#define DEFAULT_COMPRESS_PROBE 1024
+
 /* Whether to do reverse DNS lookups. */
 #define DO_HOST_LOOKUP 0
 
@@ -282,11 +300,11 @@ Homedir is prepended unless path begins with / */
 
 /* Window size limits. These tend to be a trade-off between memory
    usage and network performance: */
-/* Size of the network receive window. This amount of memory is allocated
-   as a per-channel receive buffer. Increasing this value can make a
-   significant difference to network performance. 24kB was empirically
-   chosen for a 100mbit ethernet network. The value can be altered at
-   runtime with the -W argument. */
+/* Maximum size of the network receive window. Each channel starts with a
+   smaller window and per-channel receive buffer, and grows them up to this
+   size when the link could carry more data. Increasing this value can make
+   a significant difference to network performance on fast or high latency
+   links. The value can be altered at runtime with the -W argument. */
 #define DEFAULT_RECV_WINDOW 24576
 /* Maximum size of a received SSH data packet - this _MUST_ be >= 32768
    in order to interoperate with other implementations */
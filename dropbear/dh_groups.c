@@ -1,5 +1,7 @@
 #include "options.h"
 #include "dh_groups.h"
+#include "dbutil.h"
+#include "bignum.h"
 
 #if DROPBEAR_NORMAL_DH
 
@@ -94,4 +96,236 @@ const unsigned char dh_p_16[DH_P_16_LEN] = {
 /* Same for all groups */
 const int DH_G_VAL = 2;
 
+/* g^x is done in Montgomery form, values are kept as aR mod p */
+
+/* 2^x mod p without a table takes DH_POW2_WINDOW bits of x at a time,
+ * 2^DH_POW2_WINDOW - 1 must be less than MP_DIGIT_BIT */
+#define DH_POW2_WINDOW 4
+
+#if DH_BASE_TABLE_ROWS > 0
+/* The comb of Lim and Lee. x is split into DH_BASE_TABLE_ROWS rows of
+ * cols bits, entry m of the table is the product of g^(2^(i*cols)) for
+ * each bit i set in m. g^x then takes cols squarings and cols
+ * multiplications, taking one bit from each row at a time */
+struct dh_base_table {
+	const unsigned char *dh_p_bytes;
+	int cols;
+	mp_digit rho;
+	mp_int *vals; /* 2^DH_BASE_TABLE_ROWS entries, [0] is one */
+	struct dh_base_table *next;
+};
+
+static struct dh_base_table *base_tables = NULL;
+#endif
+
+static void mont_mul(mp_int *a, const mp_int *b, const mp_int *p, mp_digit rho) {
+	if (mp_mul(a, b, a) != MP_OKAY
+		|| mp_montgomery_reduce(a, p, rho) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+}
+
+static void mont_sqr(mp_int *a, const mp_int *p, mp_digit rho) {
+	if (mp_sqr(a, a) != MP_OKAY
+		|| mp_montgomery_reduce(a, p, rho) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+}
+
+static unsigned int get_bit(const mp_int *x, int i) {
+	int digit = i / MP_DIGIT_BIT;
+	if (i < 0 || digit >= x->used) {
+		return 0;
+	}
+	return (x->dp[digit] >> (i % MP_DIGIT_BIT)) & 1;
+}
+
+/* a = a*2^w mod p, for a < p and w < MP_DIGIT_BIT. The quotient is the
+ * bits shifted above p's top bit, give or take a few p */
+static void shift_mod(mp_int *a, unsigned int w, const mp_int *p, mp_int *tmp) {
+	mp_digit q = 0;
+	int i, n = mp_count_bits(p);
+
+	if (mp_mul_2d(a, w, a) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+	for (i = w-1; i >= 0; i--) {
+		q = (q << 1) | get_bit(a, n + i);
+	}
+	if (mp_mul_d(p, q, tmp) != MP_OKAY
+		|| mp_sub(a, tmp, a) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+	while (mp_cmp_mag(a, p) != MP_LT) {
+		if (mp_sub(a, p, a) != MP_OKAY) {
+			dropbear_exit("Diffie-Hellman error");
+		}
+	}
+}
+
+/* y = 2^x mod p. Multiplying by 2^w is a shift and a subtraction of a
+ * small multiple of p, so each window costs little more than its
+ * squarings */
+static void dh_pow2(const mp_int *x, const mp_int *p, mp_int *y) {
+	mp_digit rho;
+	unsigned int w;
+	int i, j, started = 0;
+	DEF_MP_INT(tmp);
+
+	m_mp_init(&tmp);
+	if (mp_montgomery_setup(p, &rho) != MP_OKAY
+		|| mp_montgomery_calc_normalization(y, p) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+
+	i = mp_count_bits(x);
+	i += (DH_POW2_WINDOW - i % DH_POW2_WINDOW) % DH_POW2_WINDOW;
+	for (i -= DH_POW2_WINDOW; i >= 0; i -= DH_POW2_WINDOW) {
+		if (started) {
+			for (j = 0; j < DH_POW2_WINDOW; j++) {
+				mont_sqr(y, p, rho);
+			}
+		}
+		w = 0;
+		for (j = DH_POW2_WINDOW-1; j >= 0; j--) {
+			w = (w << 1) | get_bit(x, i+j);
+		}
+		if (w) {
+			shift_mod(y, w, p, &tmp);
+			started = 1;
+		}
+	}
+
+	if (mp_montgomery_reduce(y, p, rho) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+	mp_clear(&tmp);
+}
+
+#if DH_BASE_TABLE_ROWS > 0
+static struct dh_base_table *find_base_table(const unsigned char *dh_p_bytes) {
+	struct dh_base_table *t;
+	for (t = base_tables; t; t = t->next) {
+		if (t->dh_p_bytes == dh_p_bytes) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
+void dh_prepare_base_table(const unsigned char *dh_p_bytes, const mp_int *dh_p) {
+	struct dh_base_table *t = NULL;
+	unsigned int m, top, n = 1 << DH_BASE_TABLE_ROWS;
+	int i;
+
+	if (DH_G_VAL != 2 || find_base_table(dh_p_bytes)) {
+		return;
+	}
+
+	TRACE(("enter dh_prepare_base_table"))
+	t = m_malloc(sizeof(*t));
+	t->dh_p_bytes = dh_p_bytes;
+	t->cols = (mp_count_bits(dh_p) + DH_BASE_TABLE_ROWS - 1) / DH_BASE_TABLE_ROWS;
+	t->vals = m_malloc(n * sizeof(mp_int));
+	for (m = 0; m < n; m++) {
+		m_mp_init(&t->vals[m]);
+	}
+
+	if (mp_montgomery_setup(dh_p, &t->rho) != MP_OKAY
+		|| mp_montgomery_calc_normalization(&t->vals[0], dh_p) != MP_OKAY
+		|| mp_mul_2(&t->vals[0], &t->vals[1]) != MP_OKAY
+		|| mp_mod(&t->vals[1], dh_p, &t->vals[1]) != MP_OKAY) {
+		dropbear_exit("Diffie-Hellman error");
+	}
+
+	/* the rows, g^(2^(i*cols)) */
+	for (i = 1; i < DH_BASE_TABLE_ROWS; i++) {
+		mp_int *row = &t->vals[1 << i];
+		if (mp_copy(&t->vals[1 << (i-1)], row) != MP_OKAY) {
+			dropbear_exit("Diffie-Hellman error");
+		}
+		for (m = 0; m < (unsigned int)t->cols; m++) {
+			mont_sqr(row, dh_p, t->rho);
+		}
+	}
+
+	/* and their products */
+	for (m = 3; m < n; m++) {
+		for (top = m; top & (top - 1); top &= top - 1) {
+			/* find the highest bit */
+		}
+		if (m == top) {
+			continue;
+		}
+		if (mp_copy(&t->vals[m ^ top], &t->vals[m]) != MP_OKAY) {
+			dropbear_exit("Diffie-Hellman error");
+		}
+		mont_mul(&t->vals[m], &t->vals[top], dh_p, t->rho);
+	}
+
+	t->next = base_tables;
+	base_tables = t;
+	TRACE(("leave dh_prepare_base_table"))
+}
+#else
+void dh_prepare_base_table(const unsigned char *dh_p_bytes, const mp_int *dh_p) {
+	(void)dh_p_bytes;
+	(void)dh_p;
+}
+#endif /* DH_BASE_TABLE_ROWS > 0 */
+
+void dh_pow_g(const unsigned char *dh_p_bytes, const mp_int *dh_p,
+		const mp_int *x, mp_int *y) {
+#if DH_BASE_TABLE_ROWS > 0
+	struct dh_base_table *t = find_base_table(dh_p_bytes);
+	unsigned int m;
+	int i, j, started = 0;
+
+	if (t && mp_count_bits(x) <= t->cols * DH_BASE_TABLE_ROWS) {
+		for (j = t->cols-1; j >= 0; j--) {
+			if (started) {
+				mont_sqr(y, dh_p, t->rho);
+			}
+			m = 0;
+			for (i = DH_BASE_TABLE_ROWS-1; i >= 0; i--) {
+				m = (m << 1) | get_bit(x, i*t->cols + j);
+			}
+			if (!m) {
+				continue;
+			}
+			if (started) {
+				mont_mul(y, &t->vals[m], dh_p, t->rho);
+			} else {
+				if (mp_copy(&t->vals[m], y) != MP_OKAY) {
+					dropbear_exit("Diffie-Hellman error");
+				}
+				started = 1;
+			}
+		}
+		if (!started) {
+			mp_set(y, 1);
+			return;
+		}
+		if (mp_montgomery_reduce(y, dh_p, t->rho) != MP_OKAY) {
+			dropbear_exit("Diffie-Hellman error");
+		}
+		return;
+	}
+#else
+	(void)dh_p_bytes;
+#endif
+
+	if (DH_G_VAL == 2) {
+		dh_pow2(x, dh_p, y);
+	} else {
+		DEF_MP_INT(g);
+		m_mp_init(&g);
+		mp_set_ul(&g, DH_G_VAL);
+		if (mp_exptmod(&g, x, dh_p, y) != MP_OKAY) {
+			dropbear_exit("Diffie-Hellman error");
+		}
+		mp_clear(&g);
+	}
+}
+
 #endif /* DROPBEAR_NORMAL_DH */
@@ -1,6 +1,7 @@
 #ifndef DROPBEAR_DH_GROUPS_H
 #define DROPBEAR_DH_GROUPS_H
 #include "options.h"
+#include "includes.h"
 
 #if DROPBEAR_NORMAL_DH
 
@@ -21,6 +22,12 @@ extern const unsigned char dh_p_16[DH_P_16_LEN];
 
 extern const int DH_G_VAL;
 
+/* y = g^x mod p for the group with prime dh_p_bytes, loaded in dh_p */
+void dh_pow_g(const unsigned char *dh_p_bytes, const mp_int *dh_p,
+		const mp_int *x, mp_int *y);
+/* Build the fixed-base table dh_pow_g() uses for a group, once */
+void dh_prepare_base_table(const unsigned char *dh_p_bytes, const mp_int *dh_p);
+
 #endif /* DROPBEAR_NORMAL_DH */
 
 #endif
@@ -239,3 +239,65 @@ int wrapfd_select(int nfds, fd_set *readfds, fd_set *writefds,
 	return ret;
 }
 
+
+/* Like wrapfd_select(), picks one or two of the fds that want each event */
+static int wrapfd_poll_pick(struct pollfd *fds, nfds_t nfds, short event,
+	double chance1, double chance2) {
+	nfds_t i, nset, sel;
+	nfds_t fdlist[IOWRAP_MAXFD+1];
+	int ret = 0;
+
+	if (erand48(rand_state) >= chance1) {
+		return 0;
+	}
+
+	for (i = 0, nset = 0; i < nfds; i++) {
+		if (fds[i].events & event) {
+			assert(wrap_fds[fds[i].fd].mode != UNUSED);
+			fdlist[nset] = i;
+			nset++;
+		}
+	}
+
+	if (nset > 0) {
+		/* set one */
+		sel = fdlist[nrand48(rand_state) % nset];
+		if (fds[sel].revents == 0) {
+			ret++;
+		}
+		fds[sel].revents |= event;
+
+		if (erand48(rand_state) < chance2) {
+			sel = fdlist[nrand48(rand_state) % nset];
+			if (fds[sel].revents == 0) {
+				ret++;
+			}
+			fds[sel].revents |= event;
+		}
+	}
+	return ret;
+}
+
+int wrapfd_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+	nfds_t i;
+	int ret = 0;
+
+	if (!fuzz.wrapfds) {
+		return poll(fds, nfds, timeout);
+	}
+
+	assert(nfds <= IOWRAP_MAXFD+1);
+
+	if (erand48(rand_state) < CHANCE_INTR) {
+		errno = EINTR;
+		return -1;
+	}
+
+	for (i = 0; i < nfds; i++) {
+		fds[i].revents = 0;
+	}
+
+	ret += wrapfd_poll_pick(fds, nfds, POLLIN, CHANCE_READ1, CHANCE_READ2);
+	ret += wrapfd_poll_pick(fds, nfds, POLLOUT, CHANCE_WRITE1, CHANCE_WRITE2);
+	return ret;
+}
@@ -13,11 +13,12 @@ void wrapfd_setup(buffer *buf);
 void wrapfd_setseed(uint32_t seed);
 int wrapfd_new();
 
-// called via #defines for read/write/select
+// called via #defines for read/write/select/poll
 int wrapfd_read(int fd, void *out, size_t count);
 int wrapfd_write(int fd, const void* in, size_t count);
 int wrapfd_select(int nfds, fd_set *readfds, fd_set *writefds, 
     fd_set *exceptfds, struct timeval *timeout);
+int wrapfd_poll(struct pollfd *fds, nfds_t nfds, int timeout);
 int wrapfd_close(int fd);
 
 #endif // FUZZ_WRAPFD_H
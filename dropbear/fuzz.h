@@ -42,6 +42,7 @@ void fuzz_dump(const unsigned char* data, size_t len);
 #ifndef FUZZ_SKIP_WRAP
 #define select(nfds, readfds, writefds, exceptfds, timeout) \
         wrapfd_select(nfds, readfds, writefds, exceptfds, timeout)
+#define poll(fds, nfds, timeout) wrapfd_poll(fds, nfds, timeout)
 #define write(fd, buf, count) wrapfd_write(fd, buf, count)
 #define read(fd, buf, count) wrapfd_read(fd, buf, count)
 #define close(fd) wrapfd_close(fd)
@@ -46,6 +46,12 @@ static int dropbear_gcm_start(int cipher, const unsigned char *IV,
 		return err;
 	}
 	memcpy(state->iv, IV, GCM_NONCE_LEN);
+#ifdef LTC_GCM_ACCEL
+	/* gcm_process() hashes whole packets four blocks at a time when the
+	 * CPU has carry-less multiply, so keep handing it the whole payload */
+	TRACE(("gcm: GHASH using %s",
+		state->gcm.accel ? "carry-less multiply" : "tables"))
+#endif
 
 	TRACE2(("leave dropbear_gcm_start"))
 	return CRYPT_OK;
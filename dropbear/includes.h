@@ -59,6 +59,7 @@
 #include <dirent.h>
 #include <time.h>
 #include <setjmp.h>
+#include <poll.h>
 
 #ifdef HAVE_UTMP_H
 #include <utmp.h>
@@ -35,6 +35,8 @@ void send_msg_newkeys(void);
 void recv_msg_newkeys(void);
 void kexfirstinitialise(void);
 void finish_kexhashbuf(void);
+struct key_context_directional;
+void gen_mac_states(struct key_context_directional *key);
 
 #if DROPBEAR_NORMAL_DH
 struct kex_dh_param *gen_kexdh_param(void);
@@ -57,6 +59,13 @@ void kexcurve25519_comb_key(const struct kex_curve25519_param *param, const buff
 		sign_key *hostkey);
 #endif
 
+/* An ephemeral keypair made before the kex needs it, used by the next
+ * gen_kex*_param() with a compatible algo_kex */
+void kex_prepare_param(const struct dropbear_kex *algo_kex);
+void kex_prepare_likely(void);
+void kex_discard_param(void);
+void kexdh_prepare_tables(void);
+
 #ifndef DISABLE_ZLIB
 int is_compress_trans(void);
 int is_compress_recv(void);
@@ -83,6 +92,9 @@ struct KEXState {
 
 	unsigned our_first_follows_matches : 1;
 
+	unsigned prepare_kex : 1; /* set when kex_prepare_likely() should run
+								 once our KEXINIT has been written */
+
 	time_t lastkextime; /* time of the last kex */
 	unsigned int datatrans; /* data transmitted since last kex */
 	unsigned int datarecv; /* data received since last kex */
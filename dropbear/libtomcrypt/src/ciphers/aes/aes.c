@@ -33,6 +33,14 @@
 
 #ifdef LTC_RIJNDAEL
 
+#if defined(LTC_AES_ACCEL) && defined(LTC_CTR_MODE)
+static int _rijndael_ctr_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks,
+                                 unsigned char *IV, int mode, symmetric_key *skey);
+#define ACCEL_CTR _rijndael_ctr_encrypt
+#else
+#define ACCEL_CTR NULL
+#endif
+
 #ifndef ENCRYPT_ONLY
 
 #define SETUP    rijndael_setup
@@ -59,7 +67,7 @@ const struct ltc_cipher_descriptor aes_desc =
     6,
     16, 32, 16, 10,
     SETUP, ECB_ENC, ECB_DEC, ECB_TEST, ECB_DONE, ECB_KS,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+    NULL, NULL, NULL, NULL, ACCEL_CTR, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 #else
@@ -84,7 +92,7 @@ const struct ltc_cipher_descriptor aes_enc_desc =
     6,
     16, 32, 16, 10,
     SETUP, ECB_ENC, NULL, NULL, ECB_DONE, ECB_KS,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+    NULL, NULL, NULL, NULL, ACCEL_CTR, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 #endif
@@ -110,6 +118,21 @@ static ulong32 setup_mix2(ulong32 temp)
           Td3(255 & Te4[byte(temp, 0)]);
 }
 #endif
+#endif
+
+#ifdef LTC_AES_ACCEL
+/* the AES instructions take the round keys as bytes rather than
+ * big endian words */
+static void _rijndael_accel_keys(ulong32 *K, int words)
+{
+   unsigned char tmp[4];
+   int i;
+
+   for (i = 0; i < words; i++) {
+      STORE32H(K[i], tmp);
+      XMEMCPY(&K[i], tmp, 4);
+   }
+}
 #endif
 
  /**
@@ -273,6 +296,16 @@ int SETUP(const unsigned char *key, int keylen, int num_rounds, symmetric_key *s
     *rk   = *rrk;
 #endif /* ENCRYPT_ONLY */
 
+#ifdef LTC_AES_ACCEL
+    skey->rijndael.accel = rijndael_accel_available();
+    if (skey->rijndael.accel) {
+       _rijndael_accel_keys(skey->rijndael.eK, 4 * (skey->rijndael.Nr + 1));
+#ifndef ENCRYPT_ONLY
+       _rijndael_accel_keys(skey->rijndael.dK, 4 * (skey->rijndael.Nr + 1));
+#endif
+    }
+#endif
+
     return CRYPT_OK;
 }
 
@@ -296,6 +329,12 @@ int ECB_ENC(const unsigned char *pt, unsigned char *ct, symmetric_key *skey)
     LTC_ARGCHK(ct != NULL);
     LTC_ARGCHK(skey != NULL);
 
+#ifdef LTC_AES_ACCEL
+    if (skey->rijndael.accel) {
+       return rijndael_accel_ecb_encrypt(pt, ct, skey);
+    }
+#endif
+
     Nr = skey->rijndael.Nr;
     rk = skey->rijndael.eK;
 
@@ -453,6 +492,50 @@ int ECB_ENC(const unsigned char *pt, unsigned char *ct, symmetric_key *skey)
 }
 #endif
 
+#if defined(LTC_AES_ACCEL) && defined(LTC_CTR_MODE)
+/* Accelerated CTR hook for the descriptor. Keys scheduled without the
+ * AES instructions fall back to the tables a block at a time, the same
+ * as the generic CTR code */
+static int _rijndael_ctr_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks,
+                                 unsigned char *IV, int mode, symmetric_key *skey)
+{
+   unsigned char pad[16];
+   int x, err;
+
+   if (skey->rijndael.accel) {
+      return rijndael_accel_ctr_encrypt(pt, ct, blocks, IV, mode, skey);
+   }
+
+   while (blocks--) {
+      if (mode == CTR_COUNTER_LITTLE_ENDIAN) {
+         for (x = 0; x < 16; x++) {
+            if (++IV[x] != 0) {
+               break;
+            }
+         }
+      } else {
+         for (x = 15; x >= 0; x--) {
+            if (++IV[x] != 0) {
+               break;
+            }
+         }
+      }
+      if ((err = ECB_ENC(IV, pad, skey)) != CRYPT_OK) {
+         return err;
+      }
+      for (x = 0; x < 16; x++) {
+         ct[x] = pt[x] ^ pad[x];
+      }
+      pt += 16;
+      ct += 16;
+   }
+#ifdef LTC_CLEAN_STACK
+   zeromem(pad, sizeof(pad));
+#endif
+   return CRYPT_OK;
+}
+#endif
+
 #ifndef ENCRYPT_ONLY
 
 /**
@@ -475,6 +558,12 @@ int ECB_DEC(const unsigned char *ct, unsigned char *pt, symmetric_key *skey)
     LTC_ARGCHK(ct != NULL);
     LTC_ARGCHK(skey != NULL);
 
+#ifdef LTC_AES_ACCEL
+    if (skey->rijndael.accel) {
+       return rijndael_accel_ecb_decrypt(ct, pt, skey);
+    }
+#endif
+
     Nr = skey->rijndael.Nr;
     rk = skey->rijndael.dK;
 
@@ -0,0 +1,257 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ */
+
+/**
+  @file aes_accel.c
+  AES using the CPU's AES instructions: AES-NI on x86 and the ARMv8
+  crypto extensions on arm64.
+
+  The round keys are the ones rijndael_setup() computes for the table
+  code, converted to byte order at the end of rijndael_setup(). dK is the
+  "equivalent inverse cipher" schedule which is what AESDEC and
+  AESD+AESIMC expect, so no separate key expansion is needed.
+
+  Whether the instructions are present is checked at runtime, keys
+  scheduled on a CPU without them use the C tables.
+*/
+
+#include "tomcrypt.h"
+
+#ifdef LTC_AES_ACCEL
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+#define ACCEL_TARGET __attribute__((target("aes,sse2")))
+
+typedef __m128i aes_block;
+
+#define BLOCK_LOAD(p)      _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define BLOCK_STORE(p, b)  _mm_storeu_si128((__m128i *)(void *)(p), (b))
+#define BLOCK_XOR(a, b)    _mm_xor_si128((a), (b))
+
+/* AES-NI rounds include the key addition at the end */
+#define ROUND_FIRST        1
+#define ENC_FIRST(b, k)    BLOCK_XOR((b), (k))
+#define ENC_ROUND(b, k)    _mm_aesenc_si128((b), (k))
+#define ENC_LAST(b, k, k2) _mm_aesenclast_si128((b), (k2))
+#define DEC_FIRST(b, k)    BLOCK_XOR((b), (k))
+#define DEC_ROUND(b, k)    _mm_aesdec_si128((b), (k))
+#define DEC_LAST(b, k, k2) _mm_aesdeclast_si128((b), (k2))
+
+static int _accel_detect(void)
+{
+   unsigned int a, b, c, d;
+
+   if (!__get_cpuid(1, &a, &b, &c, &d)) {
+      return 0;
+   }
+   return (c & bit_AES) != 0;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+
+/* the whole module is built with +crypto, see Android.mk */
+#define ACCEL_TARGET
+
+typedef uint8x16_t aes_block;
+
+#define BLOCK_LOAD(p)      vld1q_u8((const uint8_t *)(p))
+#define BLOCK_STORE(p, b)  vst1q_u8((uint8_t *)(p), (b))
+#define BLOCK_XOR(a, b)    veorq_u8((a), (b))
+
+/* AESE/AESD add the key first, so the rounds are shifted along by one
+ * compared to AES-NI and the last key is a plain XOR */
+#define ROUND_FIRST        0
+#define ENC_FIRST(b, k)    ((void)(k), (b))
+#define ENC_ROUND(b, k)    vaesmcq_u8(vaeseq_u8((b), (k)))
+#define ENC_LAST(b, k, k2) BLOCK_XOR(vaeseq_u8((b), (k)), (k2))
+#define DEC_FIRST(b, k)    ((void)(k), (b))
+#define DEC_ROUND(b, k)    vaesimcq_u8(vaesdq_u8((b), (k)))
+#define DEC_LAST(b, k, k2) BLOCK_XOR(vaesdq_u8((b), (k)), (k2))
+
+static int _accel_detect(void)
+{
+   return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+}
+
+#else
+#error LTC_AES_ACCEL is not supported on this platform
+#endif
+
+/* number of counter blocks encrypted in parallel, enough to hide the
+ * latency of the AES round instructions */
+#define CTR_PARALLEL 8
+
+/**
+  Check whether the CPU has AES instructions, the result is cached
+  @return 1 if the accelerated functions can be used
+*/
+int rijndael_accel_available(void)
+{
+   static int avail = -1;
+
+   if (avail < 0) {
+      avail = _accel_detect();
+   }
+   return avail;
+}
+
+/* The round loops run over keys ROUND_FIRST to Nr - 2 + ROUND_FIRST,
+ * on x86 that's
+ * b ^= k[0], aesenc k[1..Nr-1], aesenclast k[Nr]
+ * and on arm64
+ * aese+aesmc k[0..Nr-2], aese k[Nr-1], b ^= k[Nr] */
+#define KEY(K, r) BLOCK_LOAD((K) + 4 * (r))
+
+/**
+  Encrypt a block with the AES instructions
+  @param pt   The input plaintext (16 bytes)
+  @param ct   The output ciphertext (16 bytes)
+  @param skey The key as scheduled by rijndael_setup()
+  @return CRYPT_OK if successful
+*/
+ACCEL_TARGET
+int rijndael_accel_ecb_encrypt(const unsigned char *pt, unsigned char *ct, symmetric_key *skey)
+{
+   const ulong32 *K = skey->rijndael.eK;
+   int r, Nr = skey->rijndael.Nr;
+   aes_block b;
+
+   b = ENC_FIRST(BLOCK_LOAD(pt), KEY(K, 0));
+   for (r = ROUND_FIRST; r < Nr - 1 + ROUND_FIRST; r++) {
+      b = ENC_ROUND(b, KEY(K, r));
+   }
+   BLOCK_STORE(ct, ENC_LAST(b, KEY(K, Nr - 1), KEY(K, Nr)));
+   return CRYPT_OK;
+}
+
+/**
+  Decrypt a block with the AES instructions
+  @param ct   The input ciphertext (16 bytes)
+  @param pt   The output plaintext (16 bytes)
+  @param skey The key as scheduled by rijndael_setup()
+  @return CRYPT_OK if successful
+*/
+ACCEL_TARGET
+int rijndael_accel_ecb_decrypt(const unsigned char *ct, unsigned char *pt, symmetric_key *skey)
+{
+   const ulong32 *K = skey->rijndael.dK;
+   int r, Nr = skey->rijndael.Nr;
+   aes_block b;
+
+   b = DEC_FIRST(BLOCK_LOAD(ct), KEY(K, 0));
+   for (r = ROUND_FIRST; r < Nr - 1 + ROUND_FIRST; r++) {
+      b = DEC_ROUND(b, KEY(K, r));
+   }
+   BLOCK_STORE(pt, DEC_LAST(b, KEY(K, Nr - 1), KEY(K, Nr)));
+   return CRYPT_OK;
+}
+
+#ifdef LTC_CTR_MODE
+/**
+  CTR mode with the AES instructions, CTR_PARALLEL counter blocks at a
+  time. Like the generic CTR code the counter is incremented before each
+  block is encrypted, across the whole 16 bytes.
+  @param pt     Plaintext
+  @param ct     [out] Ciphertext
+  @param blocks The number of complete blocks to process
+  @param IV     The counter (input/output)
+  @param mode   CTR_COUNTER_LITTLE_ENDIAN or CTR_COUNTER_BIG_ENDIAN
+  @param skey   The key as scheduled by rijndael_setup()
+  @return CRYPT_OK if successful
+*/
+ACCEL_TARGET
+int rijndael_accel_ctr_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks,
+                               unsigned char *IV, int mode, symmetric_key *skey)
+{
+   const ulong32 *K = skey->rijndael.eK;
+   aes_block b[CTR_PARALLEL], k;
+   unsigned char ctrs[CTR_PARALLEL * 16];
+   ulong64 hi, lo;
+   int i, r, n, Nr = skey->rijndael.Nr;
+
+   if (mode == CTR_COUNTER_LITTLE_ENDIAN) {
+      LOAD64L(lo, IV);
+      LOAD64L(hi, IV + 8);
+   } else {
+      LOAD64H(hi, IV);
+      LOAD64H(lo, IV + 8);
+   }
+
+   while (blocks > 0) {
+      n = blocks < CTR_PARALLEL ? (int)blocks : CTR_PARALLEL;
+
+      for (i = 0; i < n; i++) {
+         if (++lo == 0) {
+            ++hi;
+         }
+         if (mode == CTR_COUNTER_LITTLE_ENDIAN) {
+            STORE64L(lo, ctrs + 16 * i);
+            STORE64L(hi, ctrs + 16 * i + 8);
+         } else {
+            STORE64H(hi, ctrs + 16 * i);
+            STORE64H(lo, ctrs + 16 * i + 8);
+         }
+      }
+
+      /* run the blocks through round by round, so that independent
+       * AES instructions are in flight together */
+      k = KEY(K, 0);
+      for (i = 0; i < n; i++) {
+         b[i] = ENC_FIRST(BLOCK_LOAD(ctrs + 16 * i), k);
+      }
+      for (r = ROUND_FIRST; r < Nr - 1 + ROUND_FIRST; r++) {
+         k = KEY(K, r);
+         for (i = 0; i < n; i++) {
+            b[i] = ENC_ROUND(b[i], k);
+         }
+      }
+      for (i = 0; i < n; i++) {
+         b[i] = ENC_LAST(b[i], KEY(K, Nr - 1), KEY(K, Nr));
+      }
+
+      for (i = 0; i < n; i++) {
+         BLOCK_STORE(ct + 16 * i, BLOCK_XOR(BLOCK_LOAD(pt + 16 * i), b[i]));
+      }
+      pt += 16 * n;
+      ct += 16 * n;
+      blocks -= n;
+   }
+
+   if (mode == CTR_COUNTER_LITTLE_ENDIAN) {
+      STORE64L(lo, IV);
+      STORE64L(hi, IV + 8);
+   } else {
+      STORE64H(hi, IV);
+      STORE64H(lo, IV + 8);
+   }
+
+#ifdef LTC_CLEAN_STACK
+   zeromem(ctrs, sizeof(ctrs));
+   zeromem(b, sizeof(b));
+#endif
+   return CRYPT_OK;
+}
+#endif /* LTC_CTR_MODE */
+
+#endif /* LTC_AES_ACCEL */
+
+/* ref:         $Format:%D$ */
+/* git commit:  $Format:%H$ */
+/* commit time: $Format:%ai$ */
@@ -0,0 +1,248 @@
+#define LTC_SOURCE
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ */
+
+/**
+  @file gcm_accel.c
+  GCM implementation, GHASH using the CPU's carry-less multiply:
+  PCLMULQDQ on x86 and PMULL on arm64.
+
+  This follows Intel's "Carry-Less Multiplication and Its Usage for
+  Computing the GCM Mode" white paper. Blocks are byte reversed so the
+  bit-reflected GCM field elements become ordinary polynomials, multiplied
+  to 256 bits, shifted left by one and reduced modulo
+  x^128 + x^7 + x^2 + x + 1. Four blocks are hashed at a time against
+  H^4..H^1, their 256-bit products summed and reduced once.
+
+  Whether the instructions are present is checked at runtime, gcm_init()
+  falls back to the tables without them.
+*/
+#include "tomcrypt.h"
+
+#ifdef LTC_GCM_ACCEL
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+#define ACCEL_TARGET __attribute__((target("pclmul,ssse3")))
+
+typedef __m128i gf_block;
+
+#define GF_LOAD(p)      _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define GF_STORE(p, b)  _mm_storeu_si128((__m128i *)(void *)(p), (b))
+#define GF_XOR(a, b)    _mm_xor_si128((a), (b))
+#define GF_OR(a, b)     _mm_or_si128((a), (b))
+/* shifts of each 32-bit lane */
+#define GF_SHL32(a, n)  _mm_slli_epi32((a), (n))
+#define GF_SHR32(a, n)  _mm_srli_epi32((a), (n))
+/* whole register byte shifts */
+#define GF_SHLB(a, n)   _mm_slli_si128((a), (n))
+#define GF_SHRB(a, n)   _mm_srli_si128((a), (n))
+/* 64x64 carry-less multiply of the low (L) or high (H) halves of a and b */
+#define GF_MUL_LL(a, b) _mm_clmulepi64_si128((a), (b), 0x00)
+#define GF_MUL_HL(a, b) _mm_clmulepi64_si128((a), (b), 0x01)
+#define GF_MUL_LH(a, b) _mm_clmulepi64_si128((a), (b), 0x10)
+#define GF_MUL_HH(a, b) _mm_clmulepi64_si128((a), (b), 0x11)
+#define GF_BSWAP(a)     _mm_shuffle_epi8((a), \
+                           _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15))
+
+static int _accel_detect(void)
+{
+   unsigned int a, b, c, d;
+
+   if (!__get_cpuid(1, &a, &b, &c, &d)) {
+      return 0;
+   }
+   return (c & bit_PCLMUL) != 0 && (c & bit_SSSE3) != 0;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_PMULL
+#define HWCAP_PMULL (1 << 4)
+#endif
+
+/* the whole module is built with +crypto, see Android.mk */
+#define ACCEL_TARGET
+
+typedef uint8x16_t gf_block;
+
+#define GF_LOAD(p)      vld1q_u8((const uint8_t *)(p))
+#define GF_STORE(p, b)  vst1q_u8((uint8_t *)(p), (b))
+#define GF_XOR(a, b)    veorq_u8((a), (b))
+#define GF_OR(a, b)     vorrq_u8((a), (b))
+#define GF_SHL32(a, n)  vreinterpretq_u8_u32(vshlq_n_u32(vreinterpretq_u32_u8(a), (n)))
+#define GF_SHR32(a, n)  vreinterpretq_u8_u32(vshrq_n_u32(vreinterpretq_u32_u8(a), (n)))
+#define GF_SHLB(a, n)   vextq_u8(vdupq_n_u8(0), (a), 16 - (n))
+#define GF_SHRB(a, n)   vextq_u8((a), vdupq_n_u8(0), (n))
+#define GF_PMULL(a, i, b, j) \
+   vreinterpretq_u8_p128(vmull_p64((poly64_t)vgetq_lane_u64(vreinterpretq_u64_u8(a), (i)), \
+                                   (poly64_t)vgetq_lane_u64(vreinterpretq_u64_u8(b), (j))))
+#define GF_MUL_LL(a, b) GF_PMULL((a), 0, (b), 0)
+#define GF_MUL_HL(a, b) GF_PMULL((a), 1, (b), 0)
+#define GF_MUL_LH(a, b) GF_PMULL((a), 0, (b), 1)
+#define GF_MUL_HH(a, b) GF_PMULL((a), 1, (b), 1)
+#define GF_BSWAP(a)     _gf_bswap(a)
+
+static inline gf_block _gf_bswap(gf_block a)
+{
+   a = vrev64q_u8(a);
+   return vextq_u8(a, a, 8);
+}
+
+static int _accel_detect(void)
+{
+   return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+}
+
+#else
+#error LTC_GCM_ACCEL is not supported on this platform
+#endif
+
+/* 256-bit carry-less product of a and b, into lo and hi */
+static inline ACCEL_TARGET void _gf_mul256(gf_block a, gf_block b, gf_block *lo, gf_block *hi)
+{
+   gf_block m;
+
+   m   = GF_XOR(GF_MUL_HL(a, b), GF_MUL_LH(a, b));
+   *lo = GF_XOR(GF_MUL_LL(a, b), GF_SHLB(m, 8));
+   *hi = GF_XOR(GF_MUL_HH(a, b), GF_SHRB(m, 8));
+}
+
+/* shift the 256-bit product lo:hi left by one bit (the bit reflection)
+ * and reduce it modulo x^128 + x^7 + x^2 + x + 1 */
+static inline ACCEL_TARGET gf_block _gf_reduce(gf_block lo, gf_block hi)
+{
+   gf_block t1, t2, t3;
+
+   t1 = GF_SHR32(lo, 31);
+   t2 = GF_SHR32(hi, 31);
+   lo = GF_SHL32(lo, 1);
+   hi = GF_SHL32(hi, 1);
+   t3 = GF_SHRB(t1, 12);
+   t2 = GF_SHLB(t2, 4);
+   t1 = GF_SHLB(t1, 4);
+   lo = GF_OR(lo, t1);
+   hi = GF_OR(GF_OR(hi, t2), t3);
+
+   t1 = GF_XOR(GF_XOR(GF_SHL32(lo, 31), GF_SHL32(lo, 30)), GF_SHL32(lo, 25));
+   t2 = GF_SHRB(t1, 4);
+   t1 = GF_SHLB(t1, 12);
+   lo = GF_XOR(lo, t1);
+
+   t1 = GF_XOR(GF_XOR(GF_SHR32(lo, 1), GF_SHR32(lo, 2)), GF_SHR32(lo, 7));
+   lo = GF_XOR(lo, GF_XOR(t1, t2));
+   return GF_XOR(hi, lo);
+}
+
+static inline ACCEL_TARGET gf_block _gf_mult(gf_block a, gf_block b)
+{
+   gf_block lo, hi;
+
+   _gf_mul256(a, b, &lo, &hi);
+   return _gf_reduce(lo, hi);
+}
+
+/**
+  Check whether the CPU has carry-less multiply, the result is cached
+  @return 1 if the accelerated functions can be used
+*/
+int gcm_accel_available(void)
+{
+   static int avail = -1;
+
+   if (avail < 0) {
+      avail = _accel_detect();
+   }
+   return avail;
+}
+
+/**
+  Compute the powers of H used by gcm_accel_ghash()
+  @param gcm   The GCM state, with H set
+*/
+ACCEL_TARGET
+void gcm_accel_init(gcm_state *gcm)
+{
+   gf_block h, hn;
+   int x;
+
+   h = hn = GF_BSWAP(GF_LOAD(gcm->H));
+   GF_STORE(gcm->Hn[0], h);
+   for (x = 1; x < 4; x++) {
+      hn = _gf_mult(hn, h);
+      GF_STORE(gcm->Hn[x], hn);
+   }
+}
+
+/**
+  GCM multiply by H with carry-less multiply
+  @param gcm   The GCM state which holds the H value
+  @param I     The value to multiply H by
+*/
+ACCEL_TARGET
+void gcm_accel_mult_h(gcm_state *gcm, unsigned char *I)
+{
+   GF_STORE(I, GF_BSWAP(_gf_mult(GF_BSWAP(GF_LOAD(I)), GF_LOAD(gcm->Hn[0]))));
+}
+
+/**
+  GHASH whole blocks into the accumulator, X = (X ^ B) * H for each
+  @param gcm    The GCM state
+  @param in     The blocks to hash
+  @param blocks The number of 16-byte blocks
+*/
+ACCEL_TARGET
+void gcm_accel_ghash(gcm_state *gcm, const unsigned char *in, unsigned long blocks)
+{
+   gf_block x, h1, h2, h3, h4, lo, hi, tlo, thi;
+
+   x  = GF_BSWAP(GF_LOAD(gcm->X));
+   h1 = GF_LOAD(gcm->Hn[0]);
+   h2 = GF_LOAD(gcm->Hn[1]);
+   h3 = GF_LOAD(gcm->Hn[2]);
+   h4 = GF_LOAD(gcm->Hn[3]);
+
+   /* ((((X ^ B0) H ^ B1) H ^ B2) H ^ B3) H
+    *   = (X ^ B0) H^4 ^ B1 H^3 ^ B2 H^2 ^ B3 H */
+   while (blocks >= 4) {
+      _gf_mul256(GF_XOR(x, GF_BSWAP(GF_LOAD(in))), h4, &lo, &hi);
+      _gf_mul256(GF_BSWAP(GF_LOAD(in + 16)), h3, &tlo, &thi);
+      lo = GF_XOR(lo, tlo);
+      hi = GF_XOR(hi, thi);
+      _gf_mul256(GF_BSWAP(GF_LOAD(in + 32)), h2, &tlo, &thi);
+      lo = GF_XOR(lo, tlo);
+      hi = GF_XOR(hi, thi);
+      _gf_mul256(GF_BSWAP(GF_LOAD(in + 48)), h1, &tlo, &thi);
+      lo = GF_XOR(lo, tlo);
+      hi = GF_XOR(hi, thi);
+      x = _gf_reduce(lo, hi);
+      in += 64;
+      blocks -= 4;
+   }
+   while (blocks > 0) {
+      x = _gf_mult(GF_XOR(x, GF_BSWAP(GF_LOAD(in))), h1);
+      in += 16;
+      blocks--;
+   }
+
+   GF_STORE(gcm->X, GF_BSWAP(x));
+}
+
+#endif /* LTC_GCM_ACCEL */
+
+/* ref:         $Format:%D$ */
+/* git commit:  $Format:%H$ */
+/* commit time: $Format:%ai$ */
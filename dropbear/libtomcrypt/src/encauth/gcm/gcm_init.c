@@ -71,6 +71,15 @@ int gcm_init(gcm_state *gcm, int cipher,
    gcm->totlen   = 0;
    gcm->pttotlen = 0;
 
+#ifdef LTC_GCM_ACCEL
+   gcm->accel = gcm_accel_available();
+   if (gcm->accel) {
+      /* powers of H for the carry-less multiply, the tables aren't used */
+      gcm_accel_init(gcm);
+      return CRYPT_OK;
+   }
+#endif
+
 #ifdef LTC_GCM_TABLES
    /* setup tables */
 
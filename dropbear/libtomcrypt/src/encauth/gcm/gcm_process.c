@@ -16,6 +16,76 @@
 
 #ifdef LTC_GCM_MODE
 
+#ifdef LTC_GCM_ACCEL
+/* Whole blocks with nothing buffered: CTR the lot, through the cipher's
+ * accelerated CTR when it has one, and GHASH them in one go */
+static int _gcm_process_blocks(gcm_state *gcm,
+                               unsigned char *pt, unsigned char *ct,
+                               unsigned long blocks, int direction)
+{
+   const unsigned char *in;
+   unsigned char *out;
+   unsigned long x;
+   ulong32 ctr;
+   int y, err;
+
+   if (direction == GCM_ENCRYPT) {
+      in  = pt;
+      out = ct;
+   } else {
+      in  = ct;
+      out = pt;
+      /* hash before the (possibly in place) decryption */
+      gcm_accel_ghash(gcm, ct, blocks);
+   }
+
+   /* the first block's key stream is already in buf */
+   for (y = 0; y < 16; y++) {
+      out[y] = in[y] ^ gcm->buf[y];
+   }
+
+   /* the CTR hook increments all 16 bytes, GCM only the last 4, so it can
+    * only be used when those don't wrap */
+   LOAD32H(ctr, gcm->Y + 12);
+#ifdef LTC_CTR_MODE
+   if (blocks > 1 && cipher_descriptor[gcm->cipher].accel_ctr_encrypt != NULL &&
+       (ulong64)ctr + (blocks - 1) <= CONST64(0xFFFFFFFF)) {
+      if ((err = cipher_descriptor[gcm->cipher].accel_ctr_encrypt(in + 16, out + 16, blocks - 1,
+                                                                   gcm->Y, CTR_COUNTER_BIG_ENDIAN,
+                                                                   &gcm->K)) != CRYPT_OK) {
+         return err;
+      }
+      ctr += (ulong32)(blocks - 1);
+   } else
+#endif
+   {
+      for (x = 1; x < blocks; x++) {
+         ctr++;
+         STORE32H(ctr, gcm->Y + 12);
+         if ((err = cipher_descriptor[gcm->cipher].ecb_encrypt(gcm->Y, gcm->buf, &gcm->K)) != CRYPT_OK) {
+            return err;
+         }
+         for (y = 0; y < 16; y++) {
+            out[16 * x + y] = in[16 * x + y] ^ gcm->buf[y];
+         }
+      }
+   }
+
+   /* key stream for whatever comes next */
+   ctr++;
+   STORE32H(ctr, gcm->Y + 12);
+   if ((err = cipher_descriptor[gcm->cipher].ecb_encrypt(gcm->Y, gcm->buf, &gcm->K)) != CRYPT_OK) {
+      return err;
+   }
+
+   if (direction == GCM_ENCRYPT) {
+      gcm_accel_ghash(gcm, ct, blocks);
+   }
+   gcm->pttotlen += CONST64(128) * blocks;
+   return CRYPT_OK;
+}
+#endif
+
 /**
   Process plaintext/ciphertext through GCM
   @param gcm       The GCM state
@@ -84,10 +154,18 @@ int gcm_process(gcm_state *gcm,
    }
 
    x = 0;
+#ifdef LTC_GCM_ACCEL
+   if (gcm->accel && gcm->buflen == 0 && ptlen >= 16) {
+      if ((err = _gcm_process_blocks(gcm, pt, ct, ptlen / 16, direction)) != CRYPT_OK) {
+         return err;
+      }
+      x = ptlen & ~15;
+   }
+#endif
 #ifdef LTC_FAST
    if (gcm->buflen == 0) {
       if (direction == GCM_ENCRYPT) {
-         for (x = 0; x < (ptlen & ~15); x += 16) {
+         for (; x < (ptlen & ~15); x += 16) {
              /* ctr encrypt */
              for (y = 0; y < 16; y += sizeof(LTC_FAST_TYPE)) {
                  *(LTC_FAST_TYPE_PTR_CAST(&ct[x + y])) = *(LTC_FAST_TYPE_PTR_CAST(&pt[x+y])) ^ *(LTC_FAST_TYPE_PTR_CAST(&gcm->buf[y]));
@@ -105,7 +183,7 @@ int gcm_process(gcm_state *gcm,
              }
          }
       } else {
-         for (x = 0; x < (ptlen & ~15); x += 16) {
+         for (; x < (ptlen & ~15); x += 16) {
              /* ctr encrypt */
              for (y = 0; y < 16; y += sizeof(LTC_FAST_TYPE)) {
                  *(LTC_FAST_TYPE_PTR_CAST(&gcm->X[y])) ^= *(LTC_FAST_TYPE_PTR_CAST(&ct[x+y]));
@@ -43,6 +43,10 @@ struct saferp_key {
 struct rijndael_key {
    ulong32 eK[60], dK[60];
    int Nr;
+#ifdef LTC_AES_ACCEL
+   /* round keys are in byte order for the AES instructions */
+   int accel;
+#endif
 };
 #endif
 
@@ -687,6 +691,13 @@ void rijndael_enc_done(symmetric_key *skey);
 int rijndael_enc_keysize(int *keysize);
 extern const struct ltc_cipher_descriptor rijndael_desc, aes_desc;
 extern const struct ltc_cipher_descriptor rijndael_enc_desc, aes_enc_desc;
+#ifdef LTC_AES_ACCEL
+int rijndael_accel_available(void);
+int rijndael_accel_ecb_encrypt(const unsigned char *pt, unsigned char *ct, symmetric_key *skey);
+int rijndael_accel_ecb_decrypt(const unsigned char *ct, unsigned char *pt, symmetric_key *skey);
+int rijndael_accel_ctr_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks,
+                               unsigned char *IV, int mode, symmetric_key *skey);
+#endif
 #endif
 
 #ifdef LTC_XTEA
@@ -965,6 +976,12 @@ int chacha_ivctr64(chacha_state *st, const unsigned char *iv, unsigned long ivle
 int chacha_crypt(chacha_state *st, const unsigned char *in, unsigned long inlen, unsigned char *out);
 int chacha_keystream(chacha_state *st, unsigned char *out, unsigned long outlen);
 int chacha_done(chacha_state *st);
+#ifdef LTC_CHACHA_ACCEL
+int chacha_accel_available(void);
+unsigned long chacha_accel_crypt(const ulong32 *input, int rounds,
+                                 const unsigned char *in, unsigned char *out,
+                                 unsigned long blocks);
+#endif
 int chacha_test(void);
 
 #endif /* LTC_CHACHA */
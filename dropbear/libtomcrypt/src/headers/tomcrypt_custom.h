@@ -480,6 +480,11 @@
 #endif
 #endif
 
+/* Fixed size field arithmetic for the P-256 and P-384 point operations */
+#if defined(LTC_MECC) && !defined(LTC_NO_ECC_NISTP) && (defined(LTC_ECC256) || defined(LTC_ECC384))
+   #define LTC_ECC_NISTP
+#endif
+
 #if defined(LTC_DER)
    #ifndef LTC_DER_MAX_RECURSION
       /* Maximum recursion limit when processing nested ASN.1 types. */
@@ -501,6 +506,43 @@
    #define LTC_PKCS_1
 #endif
 
+/* AES-NI (x86) or ARMv8 crypto extension (arm64) AES, used when the CPU
+ * has it. arm64 needs the crypto extension enabled at compile time for
+ * the intrinsics, e.g. -march=armv8-a+crypto */
+#if defined(LTC_RIJNDAEL) && !defined(LTC_NO_AES_ACCEL) && !defined(LTC_NO_ASM) && defined(__GNUC__)
+   #if defined(__x86_64__) || defined(__i386__)
+      #define LTC_AES_ACCEL
+   #elif defined(__aarch64__) && defined(__linux__) && \
+         (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+      #define LTC_AES_ACCEL
+   #endif
+#endif
+
+/* GHASH with carry-less multiply, PCLMULQDQ (x86) or PMULL (arm64), used
+ * instead of the 64KiB tables when the CPU has it. Same build requirements
+ * as LTC_AES_ACCEL */
+#if defined(LTC_GCM_MODE) && !defined(LTC_NO_GCM_ACCEL) && !defined(LTC_NO_ASM) && defined(__GNUC__)
+   #if defined(__x86_64__) || defined(__i386__)
+      #define LTC_GCM_ACCEL
+   #elif defined(__aarch64__) && defined(__linux__) && \
+         (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+      #define LTC_GCM_ACCEL
+   #endif
+#endif
+
+/* SIMD ChaCha, SSE2/AVX2 (x86, picked at runtime) or NEON (ARM, when the
+ * build targets it) */
+#if defined(LTC_CHACHA) && !defined(LTC_NO_CHACHA_ACCEL) && !defined(LTC_NO_ASM) && defined(__GNUC__)
+   #if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__ARM_NEON)
+      #define LTC_CHACHA_ACCEL
+   #endif
+#endif
+
+/* Poly1305 with 44-bit limbs where there is a 64x64->128 multiply */
+#if defined(LTC_POLY1305) && !defined(LTC_NO_POLY1305_64) && defined(__SIZEOF_INT128__)
+   #define LTC_POLY1305_64
+#endif
+
 #if defined(LTC_PELICAN) && !defined(LTC_RIJNDAEL)
    #error Pelican-MAC requires LTC_RIJNDAEL
 #endif
@@ -39,8 +39,9 @@
 #define LTC_GCM_MODE
 #endif
 
-#if DROPBEAR_CHACHA20POLY1305
+/* ChaCha is also used by genrandom() */
 #define LTC_CHACHA
+#if DROPBEAR_CHACHA20POLY1305
 #define LTC_POLY1305
 #endif
 
@@ -107,9 +107,15 @@ void pmac_shift_xor(pmac_state *pmac);
 
 #ifdef LTC_POLY1305
 typedef struct {
+#ifdef LTC_POLY1305_64
+   ulong64 r[3];
+   ulong64 h[3];
+   ulong64 pad[2];
+#else
    ulong32 r[5];
    ulong32 h[5];
    ulong32 pad[4];
+#endif
    unsigned long leftover;
    unsigned char buffer[16];
    int final;
@@ -398,6 +404,11 @@ typedef struct {
    ulong64             totlen,       /* 64-bit counter used for IV and AAD */
                        pttotlen;     /* 64-bit counter for the PT */
 
+#ifdef LTC_GCM_ACCEL
+   int                 accel;        /* use the carry-less multiply GHASH */
+   unsigned char       Hn[4][16];    /* H^1..H^4 in the form gcm_accel.c uses */
+#endif
+
 #ifdef LTC_GCM_TABLES
    unsigned char       PC[16][256][16]  /* 16 tables of 8x128 */
 #ifdef LTC_GCM_TABLES_SSE2
@@ -409,6 +420,13 @@ __attribute__ ((aligned (16)))
 
 void gcm_mult_h(gcm_state *gcm, unsigned char *I);
 
+#ifdef LTC_GCM_ACCEL
+int gcm_accel_available(void);
+void gcm_accel_init(gcm_state *gcm);
+void gcm_accel_mult_h(gcm_state *gcm, unsigned char *I);
+void gcm_accel_ghash(gcm_state *gcm, const unsigned char *in, unsigned long blocks);
+#endif
+
 int gcm_init(gcm_state *gcm, int cipher,
              const unsigned char *key, int keylen);
 
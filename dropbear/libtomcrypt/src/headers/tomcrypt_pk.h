@@ -396,6 +396,17 @@ int ltc_ecc_fp_mul2add(ecc_point *A, void *kA,
 
 #endif
 
+#ifdef LTC_ECC_NISTP
+/* R = kG and kA*A + kB*B = C, specialised for P-256 and P-384 */
+int ltc_ecc_nistp_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map);
+#ifdef LTC_ECC_SHAMIR
+int ltc_ecc_nistp_mul2add(ecc_point *A, void *kA,
+                          ecc_point *B, void *kB,
+                          ecc_point *C,
+                          void *modulus);
+#endif
+#endif
+
 
 /* map P to affine from projective */
 int ltc_ecc_map(ecc_point *P, void *modulus, void *mp);
@@ -16,6 +16,68 @@
 
 #ifdef LTC_POLY1305
 
+#ifdef LTC_POLY1305_64
+
+/* h and r are three limbs of 44, 44 and 42 bits, products go in 128 bits */
+typedef unsigned __int128 ulong128;
+
+#define MASK44 CONST64(0xfffffffffff)
+#define MASK42 CONST64(0x3ffffffffff)
+
+/* internal only */
+static void _poly1305_block(poly1305_state *st, const unsigned char *in, unsigned long inlen)
+{
+   const ulong64 hibit = (st->final) ? 0 : ((ulong64)1 << 40); /* 1 << 128 */
+   ulong64 r0,r1,r2;
+   ulong64 s1,s2;
+   ulong64 h0,h1,h2;
+   ulong64 t0,t1;
+   ulong128 d0,d1,d2;
+   ulong64 c;
+
+   r0 = st->r[0];
+   r1 = st->r[1];
+   r2 = st->r[2];
+
+   /* 2^130 = 5 mod p, and the limbs above 2^88 are shifted by 2 */
+   s1 = r1 * (5 << 2);
+   s2 = r2 * (5 << 2);
+
+   h0 = st->h[0];
+   h1 = st->h[1];
+   h2 = st->h[2];
+
+   while (inlen >= 16) {
+      /* h += in[i] */
+      LOAD64L(t0, in + 0);
+      LOAD64L(t1, in + 8);
+      h0 += ( t0                    ) & MASK44;
+      h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+      h2 += (((t1 >> 24)            ) & MASK42) | hibit;
+
+      /* h *= r */
+      d0 = ((ulong128)h0 * r0) + ((ulong128)h1 * s2) + ((ulong128)h2 * s1);
+      d1 = ((ulong128)h0 * r1) + ((ulong128)h1 * r0) + ((ulong128)h2 * s2);
+      d2 = ((ulong128)h0 * r2) + ((ulong128)h1 * r1) + ((ulong128)h2 * r0);
+
+      /* (partial) h %= p */
+                    c = (ulong64)(d0 >> 44); h0 = (ulong64)d0 & MASK44;
+      d1 += c;      c = (ulong64)(d1 >> 44); h1 = (ulong64)d1 & MASK44;
+      d2 += c;      c = (ulong64)(d2 >> 42); h2 = (ulong64)d2 & MASK42;
+      h0 += c * 5;  c =          (h0 >> 44); h0 =          h0 & MASK44;
+      h1 += c;
+
+      in += 16;
+      inlen -= 16;
+   }
+
+   st->h[0] = h0;
+   st->h[1] = h1;
+   st->h[2] = h2;
+}
+
+#else
+
 /* internal only */
 static void _poly1305_block(poly1305_state *st, const unsigned char *in, unsigned long inlen)
 {
@@ -79,6 +141,8 @@ static void _poly1305_block(poly1305_state *st, const unsigned char *in, unsigne
    st->h[4] = h4;
 }
 
+#endif /* LTC_POLY1305_64 */
+
 /**
    Initialize an POLY1305 context.
    @param st       The POLY1305 state
@@ -88,10 +152,31 @@ static void _poly1305_block(poly1305_state *st, const unsigned char *in, unsigne
 */
 int poly1305_init(poly1305_state *st, const unsigned char *key, unsigned long keylen)
 {
+#ifdef LTC_POLY1305_64
+   ulong64 t0, t1;
+#endif
+
    LTC_ARGCHK(st  != NULL);
    LTC_ARGCHK(key != NULL);
    LTC_ARGCHK(keylen == 32);
 
+#ifdef LTC_POLY1305_64
+   /* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+   LOAD64L(t0, key + 0);
+   LOAD64L(t1, key + 8);
+   st->r[0] = ( t0                    ) & CONST64(0xffc0fffffff);
+   st->r[1] = ((t0 >> 44) | (t1 << 20)) & CONST64(0xfffffc0ffff);
+   st->r[2] = ((t1 >> 24)             ) & CONST64(0x00ffffffc0f);
+
+   /* h = 0 */
+   st->h[0] = 0;
+   st->h[1] = 0;
+   st->h[2] = 0;
+
+   /* save pad for later */
+   LOAD64L(st->pad[0], key + 16);
+   LOAD64L(st->pad[1], key + 24);
+#else
    /* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
    LOAD32L(st->r[0], key +  0); st->r[0] = (st->r[0]     ) & 0x3ffffff;
    LOAD32L(st->r[1], key +  3); st->r[1] = (st->r[1] >> 2) & 0x3ffff03;
@@ -111,6 +196,7 @@ int poly1305_init(poly1305_state *st, const unsigned char *key, unsigned long ke
    LOAD32L(st->pad[1], key + 20);
    LOAD32L(st->pad[2], key + 24);
    LOAD32L(st->pad[3], key + 28);
+#endif
 
    st->leftover = 0;
    st->final = 0;
@@ -170,10 +256,16 @@ int poly1305_process(poly1305_state *st, const unsigned char *in, unsigned long
 */
 int poly1305_done(poly1305_state *st, unsigned char *mac, unsigned long *maclen)
 {
+#ifdef LTC_POLY1305_64
+   ulong64 h0,h1,h2,c;
+   ulong64 g0,g1,g2;
+   ulong64 t0,t1;
+#else
    ulong32 h0,h1,h2,h3,h4,c;
    ulong32 g0,g1,g2,g3,g4;
    ulong64 f;
    ulong32 mask;
+#endif
 
    LTC_ARGCHK(st     != NULL);
    LTC_ARGCHK(mac    != NULL);
@@ -189,6 +281,59 @@ int poly1305_done(poly1305_state *st, unsigned char *mac, unsigned long *maclen)
       _poly1305_block(st, st->buffer, 16);
    }
 
+#ifdef LTC_POLY1305_64
+   /* fully carry h */
+   h0 = st->h[0];
+   h1 = st->h[1];
+   h2 = st->h[2];
+
+                c = (h1 >> 44); h1 &= MASK44;
+   h2 +=     c; c = (h2 >> 42); h2 &= MASK42;
+   h0 += c * 5; c = (h0 >> 44); h0 &= MASK44;
+   h1 +=     c; c = (h1 >> 44); h1 &= MASK44;
+   h2 +=     c; c = (h2 >> 42); h2 &= MASK42;
+   h0 += c * 5; c = (h0 >> 44); h0 &= MASK44;
+   h1 +=     c;
+
+   /* compute h + -p */
+   g0 = h0 + 5; c = (g0 >> 44); g0 &= MASK44;
+   g1 = h1 + c; c = (g1 >> 44); g1 &= MASK44;
+   g2 = h2 + c - ((ulong64)1 << 42);
+
+   /* select h if h < p, or h + -p if h >= p */
+   c = (g2 >> 63) - 1;
+   g0 &= c;
+   g1 &= c;
+   g2 &= c;
+   c = ~c;
+   h0 = (h0 & c) | g0;
+   h1 = (h1 & c) | g1;
+   h2 = (h2 & c) | g2;
+
+   /* h = (h + pad) % (2^128) */
+   t0 = st->pad[0];
+   t1 = st->pad[1];
+   h0 += (( t0                    ) & MASK44)    ; c = (h0 >> 44); h0 &= MASK44;
+   h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = (h1 >> 44); h1 &= MASK44;
+   h2 += (((t1 >> 24)             ) & MASK42) + c;                 h2 &= MASK42;
+
+   /* mac = h % (2^128) */
+   h0 = ((h0      ) | (h1 << 44));
+   h1 = ((h1 >> 20) | (h2 << 24));
+
+   STORE64L(h0, mac + 0);
+   STORE64L(h1, mac + 8);
+
+   /* zero out the state */
+   st->h[0] = 0;
+   st->h[1] = 0;
+   st->h[2] = 0;
+   st->r[0] = 0;
+   st->r[1] = 0;
+   st->r[2] = 0;
+   st->pad[0] = 0;
+   st->pad[1] = 0;
+#else
    /* fully carry h */
    h0 = st->h[0];
    h1 = st->h[1];
@@ -256,6 +401,7 @@ int poly1305_done(poly1305_state *st, unsigned char *mac, unsigned long *maclen)
    st->pad[1] = 0;
    st->pad[2] = 0;
    st->pad[3] = 0;
+#endif
 
    *maclen = 16;
    return CRYPT_OK;
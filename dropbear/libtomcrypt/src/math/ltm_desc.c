@@ -483,6 +483,8 @@ const ltc_math_descriptor ltm_desc = {
 #ifdef LTC_MECC
 #ifdef LTC_MECC_FP
    &ltc_ecc_fp_mulmod,
+#elif defined(LTC_ECC_NISTP)
+   &ltc_ecc_nistp_mulmod,
 #else
    &ltc_ecc_mulmod,
 #endif
@@ -492,6 +494,8 @@ const ltc_math_descriptor ltm_desc = {
 #ifdef LTC_ECC_SHAMIR
 #ifdef LTC_MECC_FP
    &ltc_ecc_fp_mul2add,
+#elif defined(LTC_ECC_NISTP)
+   &ltc_ecc_nistp_mul2add,
 #else
    &ltc_ecc_mul2add,
 #endif /* LTC_MECC_FP */
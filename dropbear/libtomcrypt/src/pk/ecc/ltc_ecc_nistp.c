@@ -0,0 +1,669 @@
+#define LTC_SOURCE
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ */
+#include "tomcrypt.h"
+
+/**
+  @file ltc_ecc_nistp.c
+  ECC point multiplication specialised for NIST P-256 and P-384.
+
+  Field elements are fixed arrays of 32-bit words on the stack, products
+  are reduced with the Solinas method of FIPS 186-4 appendix D.2 rather
+  than with generic Montgomery reduction on heap allocated mp_ints.
+  Points are in Jacobian coordinates, using a = -3.
+
+  These replace ecc_ptmul and ecc_mul2add in the math descriptor. Anything
+  that isn't on one of the two curves is passed on to ltc_ecc_mulmod() and
+  ltc_ecc_mul2add().
+*/
+
+#ifdef LTC_ECC_NISTP
+
+#define NISTP_MAXW 12
+
+typedef long long nistp_sword;
+typedef ulong32 nistp_fe[NISTP_MAXW];
+
+typedef struct {
+   nistp_fe x, y, z;
+} nistp_point;
+
+typedef struct {
+   /* size in 32-bit words */
+   int n;
+   /* the prime, least significant word first */
+   ulong32 p[NISTP_MAXW];
+   /* 2^(32n) mod p as signed multiples of each word */
+   int fold[NISTP_MAXW];
+   /* reduce a 2n word product */
+   void (*reduce)(const void *cv, ulong32 *r, const ulong32 *c);
+} nistp_curve;
+
+/* carry the signed word sums from a Solinas reduction into r. The
+ * carry out of the top is folded back in with 2^(32n) mod p, twice is
+ * enough to leave 0 <= r < 2^(32n), and then r < 2p */
+static void _fe_carry(const nistp_curve *cv, ulong32 *r, nistp_sword *acc)
+{
+   nistp_sword c;
+   ulong32 t[NISTP_MAXW], mask;
+   ulong64 b;
+   int i, j;
+
+   for (j = 0; ; j++) {
+      c = 0;
+      for (i = 0; i < cv->n; i++) {
+         c += acc[i];
+         acc[i] = c & 0xFFFFFFFF;
+         c >>= 32;
+      }
+      if (j == 2) {
+         break;
+      }
+      for (i = 0; i < cv->n; i++) {
+         acc[i] += c * cv->fold[i];
+      }
+   }
+
+   /* r = acc - p if that doesn't borrow */
+   b = 0;
+   for (i = 0; i < cv->n; i++) {
+      b = (ulong64)acc[i] - cv->p[i] - b;
+      t[i] = (ulong32)b;
+      b = (b >> 32) & 1;
+   }
+   mask = (ulong32)b - 1;
+   for (i = 0; i < cv->n; i++) {
+      r[i] = (t[i] & mask) | ((ulong32)acc[i] & ~mask);
+   }
+}
+
+#define C(i) ((nistp_sword)c[i])
+
+#ifdef LTC_ECC256
+/* FIPS 186-4 D.2.3 */
+static void _reduce256(const void *cv, ulong32 *r, const ulong32 *c)
+{
+   nistp_sword acc[8];
+
+   acc[0] = C(0) + C(8) + C(9) - C(11) - C(12) - C(13) - C(14);
+   acc[1] = C(1) + C(9) + C(10) - C(12) - C(13) - C(14) - C(15);
+   acc[2] = C(2) + C(10) + C(11) - C(13) - C(14) - C(15);
+   acc[3] = C(3) - C(8) - C(9) + 2 * C(11) + 2 * C(12) + C(13) - C(15);
+   acc[4] = C(4) - C(9) - C(10) + 2 * C(12) + 2 * C(13) + C(14);
+   acc[5] = C(5) - C(10) - C(11) + 2 * C(13) + 2 * C(14) + C(15);
+   acc[6] = C(6) - C(8) - C(9) + C(13) + 3 * C(14) + 2 * C(15);
+   acc[7] = C(7) + C(8) - C(10) - C(11) - C(12) - C(13) + 3 * C(15);
+   _fe_carry(cv, r, acc);
+}
+
+static const nistp_curve _p256 = {
+   8,
+   { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000,
+     0x00000000, 0x00000000, 0x00000001, 0xFFFFFFFF },
+   /* 2^224 - 2^192 - 2^96 + 1 */
+   { 1, 0, 0, -1, 0, 0, -1, 1 },
+   _reduce256
+};
+#endif
+
+#ifdef LTC_ECC384
+/* FIPS 186-4 D.2.4 */
+static void _reduce384(const void *cv, ulong32 *r, const ulong32 *c)
+{
+   nistp_sword acc[12];
+
+   acc[0] = C(0) + C(12) + C(20) + C(21) - C(23);
+   acc[1] = C(1) - C(12) + C(13) - C(20) + C(22) + C(23);
+   acc[2] = C(2) - C(13) + C(14) - C(21) + C(23);
+   acc[3] = C(3) + C(12) - C(14) + C(15) + C(20) + C(21) - C(22) - C(23);
+   acc[4] = C(4) + C(12) + C(13) - C(15) + C(16) + C(20) + 2 * C(21) + C(22) - 2 * C(23);
+   acc[5] = C(5) + C(13) + C(14) - C(16) + C(17) + C(21) + 2 * C(22) + C(23);
+   acc[6] = C(6) + C(14) + C(15) - C(17) + C(18) + C(22) + 2 * C(23);
+   acc[7] = C(7) + C(15) + C(16) - C(18) + C(19) + C(23);
+   acc[8] = C(8) + C(16) + C(17) - C(19) + C(20);
+   acc[9] = C(9) + C(17) + C(18) - C(20) + C(21);
+   acc[10] = C(10) + C(18) + C(19) - C(21) + C(22);
+   acc[11] = C(11) + C(19) + C(20) - C(22) + C(23);
+   _fe_carry(cv, r, acc);
+}
+
+static const nistp_curve _p384 = {
+   12,
+   { 0xFFFFFFFF, 0x00000000, 0x00000000, 0xFFFFFFFF,
+     0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+     0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
+   /* 2^128 + 2^96 - 2^32 + 1 */
+   { 1, -1, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+   _reduce384
+};
+#endif
+
+#undef C
+
+/* all the field operations take and return values in [0, p) */
+
+static void _fe_add(const nistp_curve *cv, ulong32 *r, const ulong32 *a, const ulong32 *b)
+{
+   ulong32 s[NISTP_MAXW], t[NISTP_MAXW], mask;
+   ulong64 c = 0, d = 0;
+   int i;
+
+   for (i = 0; i < cv->n; i++) {
+      c += (ulong64)a[i] + b[i];
+      s[i] = (ulong32)c;
+      c >>= 32;
+   }
+   for (i = 0; i < cv->n; i++) {
+      d = (ulong64)s[i] - cv->p[i] - d;
+      t[i] = (ulong32)d;
+      d = (d >> 32) & 1;
+   }
+   /* s - p unless the subtraction borrowed without a carry out of s */
+   mask = (ulong32)(c ^ d) - 1;
+   for (i = 0; i < cv->n; i++) {
+      r[i] = (t[i] & mask) | (s[i] & ~mask);
+   }
+}
+
+static void _fe_sub(const nistp_curve *cv, ulong32 *r, const ulong32 *a, const ulong32 *b)
+{
+   ulong32 mask;
+   ulong64 c = 0, d = 0;
+   int i;
+
+   for (i = 0; i < cv->n; i++) {
+      d = (ulong64)a[i] - b[i] - d;
+      r[i] = (ulong32)d;
+      d = (d >> 32) & 1;
+   }
+   /* add p back if it borrowed */
+   mask = (ulong32)0 - (ulong32)d;
+   for (i = 0; i < cv->n; i++) {
+      c += (ulong64)r[i] + (cv->p[i] & mask);
+      r[i] = (ulong32)c;
+      c >>= 32;
+   }
+}
+
+static void _fe_mul(const nistp_curve *cv, ulong32 *r, const ulong32 *a, const ulong32 *b)
+{
+   ulong32 c[2 * NISTP_MAXW];
+#ifdef __SIZEOF_INT128__
+   /* multiply pairs of words, a quarter of the multiplies */
+   ulong64 a64[NISTP_MAXW / 2], b64[NISTP_MAXW / 2], c64[NISTP_MAXW];
+   unsigned __int128 t;
+   int i, j, m = cv->n / 2;
+
+   for (i = 0; i < m; i++) {
+      a64[i] = a[2 * i] | ((ulong64)a[2 * i + 1] << 32);
+      b64[i] = b[2 * i] | ((ulong64)b[2 * i + 1] << 32);
+      c64[i] = 0;
+   }
+   for (i = 0; i < m; i++) {
+      t = 0;
+      for (j = 0; j < m; j++) {
+         t += (unsigned __int128)a64[i] * b64[j] + c64[i + j];
+         c64[i + j] = (ulong64)t;
+         t >>= 64;
+      }
+      c64[i + m] = (ulong64)t;
+   }
+   for (i = 0; i < 2 * m; i++) {
+      c[2 * i] = (ulong32)c64[i];
+      c[2 * i + 1] = (ulong32)(c64[i] >> 32);
+   }
+#else
+   ulong64 t;
+   int i, j;
+
+   for (i = 0; i < cv->n; i++) {
+      c[i] = 0;
+   }
+   for (i = 0; i < cv->n; i++) {
+      t = 0;
+      for (j = 0; j < cv->n; j++) {
+         t += (ulong64)a[i] * b[j] + c[i + j];
+         c[i + j] = (ulong32)t;
+         t >>= 32;
+      }
+      c[i + cv->n] = (ulong32)t;
+   }
+#endif
+   cv->reduce(cv, r, c);
+}
+
+#define _fe_sqr(cv, r, a) _fe_mul(cv, r, a, a)
+
+static ulong32 _fe_iszero(const nistp_curve *cv, const ulong32 *a)
+{
+   ulong32 t = 0;
+   int i;
+
+   for (i = 0; i < cv->n; i++) {
+      t |= a[i];
+   }
+   return ((t | ((ulong32)0 - t)) >> 31) ^ 1;
+}
+
+/* r = a^(p-2) */
+static void _fe_inv(const nistp_curve *cv, ulong32 *r, const ulong32 *a)
+{
+   nistp_fe t;
+   ulong32 e;
+   int i, j;
+
+   XMEMCPY(t, a, sizeof(t));
+   /* the top bit of p is set and the bottom word of both primes is
+    * 0xFFFFFFFF, so p-2 just has bit 1 cleared */
+   for (i = 32 * cv->n - 2; i >= 0; i--) {
+      j = i / 32;
+      e = cv->p[j];
+      if (j == 0) {
+         e -= 2;
+      }
+      _fe_sqr(cv, t, t);
+      if ((e >> (i % 32)) & 1) {
+         _fe_mul(cv, t, t, a);
+      }
+   }
+   XMEMCPY(r, t, sizeof(t));
+}
+
+/* constant time r = b ? a : r */
+static void _fe_cmov(const nistp_curve *cv, ulong32 *r, const ulong32 *a, ulong32 b)
+{
+   ulong32 mask = (ulong32)0 - b;
+   int i;
+
+   for (i = 0; i < cv->n; i++) {
+      r[i] ^= mask & (r[i] ^ a[i]);
+   }
+}
+
+static void _point_cmov(const nistp_curve *cv, nistp_point *r, const nistp_point *a, ulong32 b)
+{
+   _fe_cmov(cv, r->x, a->x, b);
+   _fe_cmov(cv, r->y, a->y, b);
+   _fe_cmov(cv, r->z, a->z, b);
+}
+
+/* the point at infinity has z == 0 */
+static void _point_set_inf(nistp_point *r)
+{
+   XMEMSET(r, 0, sizeof(*r));
+   r->x[0] = 1;
+   r->y[0] = 1;
+}
+
+/* r = 2a, "dbl-2001-b" from the Explicit-Formulas Database */
+static void _point_dbl(const nistp_curve *cv, nistp_point *r, const nistp_point *a)
+{
+   nistp_fe delta, gamma, beta, alpha, t1, t2;
+
+   _fe_sqr(cv, delta, a->z);
+   _fe_sqr(cv, gamma, a->y);
+   _fe_mul(cv, beta, a->x, gamma);
+
+   /* alpha = 3 (x - delta)(x + delta) */
+   _fe_sub(cv, t1, a->x, delta);
+   _fe_add(cv, t2, a->x, delta);
+   _fe_mul(cv, t1, t1, t2);
+   _fe_add(cv, alpha, t1, t1);
+   _fe_add(cv, alpha, alpha, t1);
+
+   /* z3 = (y + z)^2 - gamma - delta */
+   _fe_add(cv, t1, a->y, a->z);
+   _fe_sqr(cv, t1, t1);
+   _fe_sub(cv, t1, t1, gamma);
+   _fe_sub(cv, r->z, t1, delta);
+
+   /* x3 = alpha^2 - 8 beta */
+   _fe_add(cv, beta, beta, beta);
+   _fe_add(cv, beta, beta, beta);
+   _fe_add(cv, t1, beta, beta);
+   _fe_sqr(cv, t2, alpha);
+   _fe_sub(cv, r->x, t2, t1);
+
+   /* y3 = alpha (4 beta - x3) - 8 gamma^2 */
+   _fe_sub(cv, t1, beta, r->x);
+   _fe_mul(cv, t1, t1, alpha);
+   _fe_sqr(cv, gamma, gamma);
+   _fe_add(cv, gamma, gamma, gamma);
+   _fe_add(cv, gamma, gamma, gamma);
+   _fe_add(cv, gamma, gamma, gamma);
+   _fe_sub(cv, r->y, t1, gamma);
+}
+
+/* r = a + b, "add-2007-bl". Either input may be the point at infinity,
+ * that is handled in constant time. a == b only happens for scalars
+ * outside [1, order), it branches to a doubling. */
+static void _point_add(const nistp_curve *cv, nistp_point *r, const nistp_point *a, const nistp_point *b)
+{
+   nistp_fe z1z1, z2z2, u1, u2, s1, s2, h, i, j, rr, v;
+   nistp_point res;
+   ulong32 ainf, binf;
+
+   _fe_sqr(cv, z1z1, a->z);
+   _fe_sqr(cv, z2z2, b->z);
+   _fe_mul(cv, u1, a->x, z2z2);
+   _fe_mul(cv, u2, b->x, z1z1);
+   _fe_mul(cv, s1, a->y, b->z);
+   _fe_mul(cv, s1, s1, z2z2);
+   _fe_mul(cv, s2, b->y, a->z);
+   _fe_mul(cv, s2, s2, z1z1);
+   _fe_sub(cv, h, u2, u1);
+   _fe_sub(cv, rr, s2, s1);
+
+   ainf = _fe_iszero(cv, a->z);
+   binf = _fe_iszero(cv, b->z);
+   if ((ainf | binf | (_fe_iszero(cv, h) ^ 1)) == 0) {
+      if (_fe_iszero(cv, rr)) {
+         _point_dbl(cv, r, a);
+      } else {
+         _point_set_inf(r);
+      }
+      return;
+   }
+
+   /* i = (2h)^2, j = h i, rr = 2 (s2 - s1), v = u1 i */
+   _fe_add(cv, i, h, h);
+   _fe_sqr(cv, i, i);
+   _fe_mul(cv, j, h, i);
+   _fe_add(cv, rr, rr, rr);
+   _fe_mul(cv, v, u1, i);
+
+   /* x3 = rr^2 - j - 2v */
+   _fe_sqr(cv, res.x, rr);
+   _fe_sub(cv, res.x, res.x, j);
+   _fe_sub(cv, res.x, res.x, v);
+   _fe_sub(cv, res.x, res.x, v);
+
+   /* y3 = rr (v - x3) - 2 s1 j */
+   _fe_sub(cv, v, v, res.x);
+   _fe_mul(cv, v, v, rr);
+   _fe_mul(cv, s1, s1, j);
+   _fe_add(cv, s1, s1, s1);
+   _fe_sub(cv, res.y, v, s1);
+
+   /* z3 = ((z1 + z2)^2 - z1z1 - z2z2) h */
+   _fe_add(cv, res.z, a->z, b->z);
+   _fe_sqr(cv, res.z, res.z);
+   _fe_sub(cv, res.z, res.z, z1z1);
+   _fe_sub(cv, res.z, res.z, z2z2);
+   _fe_mul(cv, res.z, res.z, h);
+
+   _point_cmov(cv, &res, b, ainf);
+   _point_cmov(cv, &res, a, binf);
+   XMEMCPY(r, &res, sizeof(res));
+}
+
+/* tab[i] = i P for 0 <= i < 16 */
+static void _point_table(const nistp_curve *cv, nistp_point *tab, const nistp_point *P)
+{
+   int i;
+
+   _point_set_inf(&tab[0]);
+   XMEMCPY(&tab[1], P, sizeof(*P));
+   _point_dbl(cv, &tab[2], P);
+   for (i = 3; i < 16; i++) {
+      _point_add(cv, &tab[i], &tab[i - 1], P);
+   }
+}
+
+/* the curve whose prime is modulus, or NULL */
+static const nistp_curve *_find_curve(void *modulus)
+{
+   unsigned char buf[4 * NISTP_MAXW];
+   const nistp_curve *cv = NULL;
+   ulong32 w;
+   int i;
+
+   switch (mp_count_bits(modulus)) {
+#ifdef LTC_ECC256
+      case 256: cv = &_p256; break;
+#endif
+#ifdef LTC_ECC384
+      case 384: cv = &_p384; break;
+#endif
+      default: return NULL;
+   }
+   if (mp_to_unsigned_bin(modulus, buf) != CRYPT_OK) {
+      return NULL;
+   }
+   for (i = 0; i < cv->n; i++) {
+      LOAD32H(w, buf + 4 * (cv->n - 1 - i));
+      if (w != cv->p[i]) {
+         return NULL;
+      }
+   }
+   return cv;
+}
+
+/* big endian bytes of a, zero padded to 4n. a must be under 2^(32n) */
+static int _to_bytes(const nistp_curve *cv, unsigned char *out, void *a)
+{
+   unsigned long len = mp_unsigned_bin_size(a);
+
+   if (len > 4 * (unsigned long)cv->n) {
+      return CRYPT_INVALID_ARG;
+   }
+   XMEMSET(out, 0, 4 * cv->n - len);
+   return mp_to_unsigned_bin(a, out + 4 * cv->n - len);
+}
+
+static int _fe_from_mp(const nistp_curve *cv, ulong32 *r, void *a)
+{
+   unsigned char buf[4 * NISTP_MAXW];
+   nistp_fe zero = { 0 };
+   int i, err;
+
+   if ((err = _to_bytes(cv, buf, a)) != CRYPT_OK) {
+      return err;
+   }
+   for (i = 0; i < cv->n; i++) {
+      LOAD32H(r[i], buf + 4 * (cv->n - 1 - i));
+   }
+   /* a < 2^(32n) < 2p */
+   _fe_add(cv, r, r, zero);
+   return CRYPT_OK;
+}
+
+static int _fe_to_mp(const nistp_curve *cv, void *r, const ulong32 *a)
+{
+   unsigned char buf[4 * NISTP_MAXW];
+   int i;
+
+   for (i = 0; i < cv->n; i++) {
+      STORE32H(a[i], buf + 4 * (cv->n - 1 - i));
+   }
+   return mp_read_unsigned_bin(r, buf, 4 * cv->n);
+}
+
+static int _point_from_ecc(const nistp_curve *cv, nistp_point *r, ecc_point *P)
+{
+   int err;
+
+   if ((err = _fe_from_mp(cv, r->x, P->x)) != CRYPT_OK) {
+      return err;
+   }
+   if ((err = _fe_from_mp(cv, r->y, P->y)) != CRYPT_OK) {
+      return err;
+   }
+   return _fe_from_mp(cv, r->z, P->z);
+}
+
+/* convert to affine coordinates in R, P must not be the point at infinity */
+static int _point_to_ecc(const nistp_curve *cv, ecc_point *R, const nistp_point *P)
+{
+   nistp_fe zi, zi2, t;
+   int err;
+
+   _fe_inv(cv, zi, P->z);
+   _fe_sqr(cv, zi2, zi);
+   _fe_mul(cv, t, P->x, zi2);
+   if ((err = _fe_to_mp(cv, R->x, t)) != CRYPT_OK) {
+      return err;
+   }
+   _fe_mul(cv, zi2, zi2, zi);
+   _fe_mul(cv, t, P->y, zi2);
+   if ((err = _fe_to_mp(cv, R->y, t)) != CRYPT_OK) {
+      return err;
+   }
+   return mp_set(R->z, 1);
+}
+
+/**
+   Perform a point multiplication, R = kG. P-256 and P-384 use a fixed
+   4-bit window with constant time table lookups, other curves or
+   unmapped results go to ltc_ecc_mulmod().
+   @param k    The scalar to multiply by
+   @param G    The base point
+   @param R    [out] Destination for kG
+   @param modulus  The modulus of the field the ECC curve is in
+   @param map      Boolean whether to map back to affine or not (1==map, 0 == leave in projective)
+   @return CRYPT_OK on success
+*/
+int ltc_ecc_nistp_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map)
+{
+   const nistp_curve *cv;
+   nistp_point tab[16], Q, T;
+   unsigned char kb[4 * NISTP_MAXW];
+   ulong32 d;
+   int i, j, err;
+
+   LTC_ARGCHK(k       != NULL);
+   LTC_ARGCHK(G       != NULL);
+   LTC_ARGCHK(R       != NULL);
+   LTC_ARGCHK(modulus != NULL);
+
+   /* projective results are in ltc_ecc_mulmod()'s montgomery form */
+   if (!map || (cv = _find_curve(modulus)) == NULL
+         || mp_count_bits(k) > 32 * cv->n) {
+      return ltc_ecc_mulmod(k, G, R, modulus, map);
+   }
+
+   if ((err = _to_bytes(cv, kb, k)) != CRYPT_OK) {
+      goto done;
+   }
+   if ((err = _point_from_ecc(cv, &T, G)) != CRYPT_OK) {
+      goto done;
+   }
+   _point_table(cv, tab, &T);
+
+   _point_set_inf(&Q);
+   for (i = 0; i < 8 * cv->n; i++) {
+      d = (kb[i / 2] >> (i & 1 ? 0 : 4)) & 15;
+      _point_dbl(cv, &Q, &Q);
+      _point_dbl(cv, &Q, &Q);
+      _point_dbl(cv, &Q, &Q);
+      _point_dbl(cv, &Q, &Q);
+      for (j = 0; j < 16; j++) {
+         _point_cmov(cv, &T, &tab[j], (((ulong32)j ^ d) - 1) >> 31);
+      }
+      _point_add(cv, &Q, &Q, &T);
+   }
+
+   if (_fe_iszero(cv, Q.z)) {
+      /* k is 0 mod the order, leave the result (or error) to the generic code */
+      err = ltc_ecc_mulmod(k, G, R, modulus, map);
+   } else {
+      err = _point_to_ecc(cv, R, &Q);
+   }
+
+done:
+#ifdef LTC_CLEAN_STACK
+   zeromem(kb, sizeof(kb));
+   zeromem(tab, sizeof(tab));
+   zeromem(&Q, sizeof(Q));
+   zeromem(&T, sizeof(T));
+#endif
+   return err;
+}
+
+#ifdef LTC_ECC_SHAMIR
+/**
+   Computes kA*A + kB*B = C, interleaving 4-bit windows of both scalars.
+   This is not constant time, it is for signature verification where
+   everything is public. Curves other than P-256 and P-384 go to
+   ltc_ecc_mul2add().
+   @param A        First point to multiply
+   @param kA       What to multiple A by
+   @param B        Second point to multiply
+   @param kB       What to multiple B by
+   @param C        [out] Destination point (can overlap with A or B)
+   @param modulus  Modulus for curve
+   @return CRYPT_OK on success
+*/
+int ltc_ecc_nistp_mul2add(ecc_point *A, void *kA,
+                          ecc_point *B, void *kB,
+                          ecc_point *C,
+                          void *modulus)
+{
+   const nistp_curve *cv;
+   nistp_point tabA[16], tabB[16], Q, T;
+   unsigned char ka[4 * NISTP_MAXW], kb[4 * NISTP_MAXW];
+   int i, da, db, err;
+
+   LTC_ARGCHK(A       != NULL);
+   LTC_ARGCHK(B       != NULL);
+   LTC_ARGCHK(C       != NULL);
+   LTC_ARGCHK(kA      != NULL);
+   LTC_ARGCHK(kB      != NULL);
+   LTC_ARGCHK(modulus != NULL);
+
+   if ((cv = _find_curve(modulus)) == NULL
+         || mp_count_bits(kA) > 32 * cv->n || mp_count_bits(kB) > 32 * cv->n) {
+      return ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
+   }
+
+   if ((err = _to_bytes(cv, ka, kA)) != CRYPT_OK) {
+      return err;
+   }
+   if ((err = _to_bytes(cv, kb, kB)) != CRYPT_OK) {
+      return err;
+   }
+   if ((err = _point_from_ecc(cv, &T, A)) != CRYPT_OK) {
+      return err;
+   }
+   _point_table(cv, tabA, &T);
+   if ((err = _point_from_ecc(cv, &T, B)) != CRYPT_OK) {
+      return err;
+   }
+   _point_table(cv, tabB, &T);
+
+   _point_set_inf(&Q);
+   for (i = 0; i < 8 * cv->n; i++) {
+      da = (ka[i / 2] >> (i & 1 ? 0 : 4)) & 15;
+      db = (kb[i / 2] >> (i & 1 ? 0 : 4)) & 15;
+      if (!_fe_iszero(cv, Q.z)) {
+         _point_dbl(cv, &Q, &Q);
+         _point_dbl(cv, &Q, &Q);
+         _point_dbl(cv, &Q, &Q);
+         _point_dbl(cv, &Q, &Q);
+      }
+      if (da) {
+         _point_add(cv, &Q, &Q, &tabA[da]);
+      }
+      if (db) {
+         _point_add(cv, &Q, &Q, &tabB[db]);
+      }
+   }
+
+   if (_fe_iszero(cv, Q.z)) {
+      return ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
+   }
+   return _point_to_ecc(cv, C, &Q);
+}
+#endif /* LTC_ECC_SHAMIR */
+
+#endif /* LTC_ECC_NISTP */
+
+/* ref:         $Format:%D$ */
+/* git commit:  $Format:%H$ */
+/* commit time: $Format:%ai$ */
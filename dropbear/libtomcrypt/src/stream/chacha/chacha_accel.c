@@ -0,0 +1,307 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ */
+
+/**
+  @file chacha_accel.c
+  ChaCha with SIMD: several blocks at once, one block per vector lane.
+  SSE2 (4 blocks) and AVX2 (8 blocks) on x86, picked at runtime, and
+  NEON (4 blocks) on ARM.
+
+  Each vector holds one state word of all the blocks, so the rounds are
+  the scalar ones done lane-wise, and the result is transposed back into
+  whole blocks before XORing with the input. Only the low counter word
+  (input[12]) is stepped, chacha_crypt() stops the batch before it wraps.
+*/
+
+#include "tomcrypt.h"
+
+#ifdef LTC_CHACHA_ACCEL
+
+#define CHACHA_QUARTERROUND(a, b, c, d) \
+   x[a] = V_ADD(x[a], x[b]); x[d] = V_ROTL16(V_XOR(x[d], x[a])); \
+   x[c] = V_ADD(x[c], x[d]); x[b] = V_ROTL12(V_XOR(x[b], x[c])); \
+   x[a] = V_ADD(x[a], x[b]); x[d] = V_ROTL8(V_XOR(x[d], x[a]));  \
+   x[c] = V_ADD(x[c], x[d]); x[b] = V_ROTL7(V_XOR(x[b], x[c]));
+
+#define CHACHA_DOUBLEROUND \
+   CHACHA_QUARTERROUND(0, 4,  8, 12) \
+   CHACHA_QUARTERROUND(1, 5,  9, 13) \
+   CHACHA_QUARTERROUND(2, 6, 10, 14) \
+   CHACHA_QUARTERROUND(3, 7, 11, 15) \
+   CHACHA_QUARTERROUND(0, 5, 10, 15) \
+   CHACHA_QUARTERROUND(1, 6, 11, 12) \
+   CHACHA_QUARTERROUND(2, 7,  8, 13) \
+   CHACHA_QUARTERROUND(3, 4,  9, 14)
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/* ---- SSE2, 4 blocks ---- */
+
+#define V_ADD(a, b)   _mm_add_epi32((a), (b))
+#define V_XOR(a, b)   _mm_xor_si128((a), (b))
+#define V_ROTL(a, n)  _mm_or_si128(_mm_slli_epi32((a), (n)), _mm_srli_epi32((a), 32 - (n)))
+#define V_ROTL16(a)   V_ROTL((a), 16)
+#define V_ROTL12(a)   V_ROTL((a), 12)
+#define V_ROTL8(a)    V_ROTL((a), 8)
+#define V_ROTL7(a)    V_ROTL((a), 7)
+
+/* 4x4 transpose of 32-bit words, within each 128-bit lane */
+#define V_TRANSPOSE4(UNPACK, a, b, c, d) do {              \
+   __typeof__(a) t0 = UNPACK##lo_epi32((a), (b));           \
+   __typeof__(a) t1 = UNPACK##lo_epi32((c), (d));           \
+   __typeof__(a) t2 = UNPACK##hi_epi32((a), (b));           \
+   __typeof__(a) t3 = UNPACK##hi_epi32((c), (d));           \
+   (a) = UNPACK##lo_epi64(t0, t1);                          \
+   (b) = UNPACK##hi_epi64(t0, t1);                          \
+   (c) = UNPACK##lo_epi64(t2, t3);                          \
+   (d) = UNPACK##hi_epi64(t2, t3);                          \
+} while (0)
+
+__attribute__((target("sse2")))
+static void _chacha_blocks4(const ulong32 *input, int rounds,
+                            const unsigned char *in, unsigned char *out)
+{
+   __m128i x[16], j[16];
+   int i, b;
+
+   for (i = 0; i < 16; i++) {
+      j[i] = _mm_set1_epi32((int)input[i]);
+   }
+   j[12] = _mm_add_epi32(j[12], _mm_set_epi32(3, 2, 1, 0));
+   for (i = 0; i < 16; i++) {
+      x[i] = j[i];
+   }
+
+   for (i = rounds; i > 0; i -= 2) {
+      CHACHA_DOUBLEROUND
+   }
+
+   for (i = 0; i < 16; i += 4) {
+      x[i    ] = V_ADD(x[i    ], j[i    ]);
+      x[i + 1] = V_ADD(x[i + 1], j[i + 1]);
+      x[i + 2] = V_ADD(x[i + 2], j[i + 2]);
+      x[i + 3] = V_ADD(x[i + 3], j[i + 3]);
+      /* now x[i + b] is words i..i+3 of block b */
+      V_TRANSPOSE4(_mm_unpack, x[i], x[i + 1], x[i + 2], x[i + 3]);
+      for (b = 0; b < 4; b++) {
+         _mm_storeu_si128((__m128i *)(void *)(out + 64 * b + 4 * i),
+            V_XOR(_mm_loadu_si128((const __m128i *)(const void *)(in + 64 * b + 4 * i)), x[i + b]));
+      }
+   }
+
+#ifdef LTC_CLEAN_STACK
+   zeromem(x, sizeof(x));
+#endif
+}
+
+#undef V_ADD
+#undef V_XOR
+#undef V_ROTL16
+#undef V_ROTL8
+
+/* ---- AVX2, 8 blocks ---- */
+
+#define V_ADD(a, b)   _mm256_add_epi32((a), (b))
+#define V_XOR(a, b)   _mm256_xor_si256((a), (b))
+#undef V_ROTL
+#define V_ROTL(a, n)  _mm256_or_si256(_mm256_slli_epi32((a), (n)), _mm256_srli_epi32((a), 32 - (n)))
+/* the byte-sized rotations are a byte shuffle */
+#define V_ROTL16(a)   _mm256_shuffle_epi8((a), rot16)
+#define V_ROTL8(a)    _mm256_shuffle_epi8((a), rot8)
+
+__attribute__((target("avx2")))
+static void _chacha_blocks8(const ulong32 *input, int rounds,
+                            const unsigned char *in, unsigned char *out)
+{
+   const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                         13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+   const __m256i rot8  = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+   __m256i x[16], j[16], lo, hi;
+   int i, b;
+
+   for (i = 0; i < 16; i++) {
+      j[i] = _mm256_set1_epi32((int)input[i]);
+   }
+   j[12] = _mm256_add_epi32(j[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+   for (i = 0; i < 16; i++) {
+      x[i] = j[i];
+   }
+
+   for (i = rounds; i > 0; i -= 2) {
+      CHACHA_DOUBLEROUND
+   }
+
+   for (i = 0; i < 16; i++) {
+      x[i] = V_ADD(x[i], j[i]);
+   }
+   for (i = 0; i < 16; i += 8) {
+      /* x[i + b] is words i..i+3 of blocks b and b + 4, in the low and
+       * high 128 bits, x[i + 4 + b] likewise for words i+4..i+7 */
+      V_TRANSPOSE4(_mm256_unpack, x[i], x[i + 1], x[i + 2], x[i + 3]);
+      V_TRANSPOSE4(_mm256_unpack, x[i + 4], x[i + 5], x[i + 6], x[i + 7]);
+      for (b = 0; b < 4; b++) {
+         lo = _mm256_permute2x128_si256(x[i + b], x[i + 4 + b], 0x20);
+         hi = _mm256_permute2x128_si256(x[i + b], x[i + 4 + b], 0x31);
+         _mm256_storeu_si256((__m256i *)(void *)(out + 64 * b + 4 * i),
+            V_XOR(_mm256_loadu_si256((const __m256i *)(const void *)(in + 64 * b + 4 * i)), lo));
+         _mm256_storeu_si256((__m256i *)(void *)(out + 64 * (b + 4) + 4 * i),
+            V_XOR(_mm256_loadu_si256((const __m256i *)(const void *)(in + 64 * (b + 4) + 4 * i)), hi));
+      }
+   }
+
+#ifdef LTC_CLEAN_STACK
+   zeromem(x, sizeof(x));
+#endif
+}
+
+#define CHACHA_HAVE_BLOCKS8
+
+/* 0 = none, 1 = SSE2, 2 = AVX2 as well */
+static int _accel_detect(void)
+{
+   unsigned int a, b, c, d;
+   int level = 0;
+
+   if (!__get_cpuid(1, &a, &b, &c, &d) || !(d & bit_SSE2)) {
+      return 0;
+   }
+   level = 1;
+   /* AVX2 also needs the OS to save the YMM registers */
+   if ((c & bit_OSXSAVE) && __get_cpuid_max(0, NULL) >= 7) {
+      unsigned int xcr0, xcr0_hi;
+      __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+      __cpuid_count(7, 0, a, b, c, d);
+      if ((xcr0 & 6) == 6 && (b & bit_AVX2)) {
+         level = 2;
+      }
+   }
+   return level;
+}
+
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#define V_ADD(a, b)   vaddq_u32((a), (b))
+#define V_XOR(a, b)   veorq_u32((a), (b))
+#define V_ROTL(a, n)  vsriq_n_u32(vshlq_n_u32((a), (n)), (a), 32 - (n))
+#define V_ROTL16(a)   vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(a)))
+#define V_ROTL12(a)   V_ROTL((a), 12)
+#define V_ROTL8(a)    V_ROTL((a), 8)
+#define V_ROTL7(a)    V_ROTL((a), 7)
+
+static void _chacha_blocks4(const ulong32 *input, int rounds,
+                            const unsigned char *in, unsigned char *out)
+{
+   static const ulong32 lanes[4] = { 0, 1, 2, 3 };
+   uint32x4_t x[16], j[16];
+   uint32x4x2_t t0, t1;
+   int i, b;
+
+   for (i = 0; i < 16; i++) {
+      j[i] = vdupq_n_u32(input[i]);
+   }
+   j[12] = vaddq_u32(j[12], vld1q_u32(lanes));
+   for (i = 0; i < 16; i++) {
+      x[i] = j[i];
+   }
+
+   for (i = rounds; i > 0; i -= 2) {
+      CHACHA_DOUBLEROUND
+   }
+
+   for (i = 0; i < 16; i += 4) {
+      /* transpose so that x[i + b] is words i..i+3 of block b */
+      t0 = vtrnq_u32(V_ADD(x[i], j[i]), V_ADD(x[i + 1], j[i + 1]));
+      t1 = vtrnq_u32(V_ADD(x[i + 2], j[i + 2]), V_ADD(x[i + 3], j[i + 3]));
+      x[i    ] = vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0]));
+      x[i + 1] = vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1]));
+      x[i + 2] = vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0]));
+      x[i + 3] = vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1]));
+      for (b = 0; b < 4; b++) {
+         vst1q_u8(out + 64 * b + 4 * i,
+            veorq_u8(vld1q_u8(in + 64 * b + 4 * i), vreinterpretq_u8_u32(x[i + b])));
+      }
+   }
+
+#ifdef LTC_CLEAN_STACK
+   zeromem(x, sizeof(x));
+#endif
+}
+
+/* NEON is part of the build target, see tomcrypt_custom.h */
+static int _accel_detect(void)
+{
+   return 1;
+}
+
+#else
+#error LTC_CHACHA_ACCEL is not supported on this platform
+#endif
+
+/**
+  Check which SIMD ChaCha code the CPU can run, the result is cached
+  @return 0 if none, otherwise nonzero
+*/
+int chacha_accel_available(void)
+{
+   static int avail = -1;
+
+   if (avail < 0) {
+      avail = _accel_detect();
+   }
+   return avail;
+}
+
+/**
+  Encrypt (or decrypt) whole blocks with the SIMD code, in batches of 4
+  or 8. The caller makes sure the low counter word doesn't wrap.
+  @param input   The ChaCha state words, input[12] is the first block's counter
+  @param rounds  The number of rounds
+  @param in      The plaintext (or ciphertext)
+  @param out     [out] The ciphertext (or plaintext)
+  @param blocks  The number of 64-byte blocks available
+  @return The number of blocks processed, a multiple of 4 and at most blocks
+*/
+unsigned long chacha_accel_crypt(const ulong32 *input, int rounds,
+                                 const unsigned char *in, unsigned char *out,
+                                 unsigned long blocks)
+{
+   ulong32 st[16];
+   unsigned long done = 0;
+
+   XMEMCPY(st, input, sizeof(st));
+#ifdef CHACHA_HAVE_BLOCKS8
+   if (chacha_accel_available() > 1) {
+      for (; blocks - done >= 8; done += 8) {
+         _chacha_blocks8(st, rounds, in + 64 * done, out + 64 * done);
+         st[12] += 8;
+      }
+   }
+#endif
+   for (; blocks - done >= 4; done += 4) {
+      _chacha_blocks4(st, rounds, in + 64 * done, out + 64 * done);
+      st[12] += 4;
+   }
+
+#ifdef LTC_CLEAN_STACK
+   zeromem(st, sizeof(st));
+#endif
+   return done;
+}
+
+#endif /* LTC_CHACHA_ACCEL */
+
+/* ref:         $Format:%D$ */
+/* git commit:  $Format:%H$ */
+/* commit time: $Format:%ai$ */
@@ -71,6 +71,19 @@ int chacha_crypt(chacha_state *st, const unsigned char *in, unsigned long inlen,
       out += j;
       in  += j;
    }
+#ifdef LTC_CHACHA_ACCEL
+   if (inlen >= 4 * 64 && chacha_accel_available()) {
+      /* the SIMD code only steps input[12], stop before it wraps and leave
+       * that to the loop below */
+      j = MIN(inlen / 64, 0xFFFFFFFFUL - st->input[12]);
+      j = chacha_accel_crypt(st->input, st->rounds, in, out, j);
+      st->input[12] += (ulong32)j;
+      inlen -= 64 * j;
+      if (inlen == 0) return CRYPT_OK;
+      out += 64 * j;
+      in  += 64 * j;
+   }
+#endif
    for (;;) {
      _chacha_block(buf, st->input, st->rounds);
      if (st->ivlen == 8) {
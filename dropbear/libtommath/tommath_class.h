@@ -1307,13 +1307,18 @@
 #   define LTM_LAST
 #endif
 
-/* Dropbear doesn't need these. */
+/* From bench-math. Dropbear's largest numbers are 4096 bits, 69 digits with
+ * 60 bit digits and 147 with the 28 bit digits of the 32 bit ABIs. Comba
+ * beats Karatsuba and Toom-Cook at every size it handles, but comba
+ * squaring stops at MP_MAXFAST/2 = 128 digits and the schoolbook squarer
+ * after it is slower than one level of Karatsuba, so that is used from there
+ * (KARATSUBA_SQR_CUTOFF in tommath_cutoffs.h). It only changes the 32 bit
+ * ABIs. Multiplication keeps comba, which goes to 256 digits. */
 #undef BN_MP_KARATSUBA_MUL_C
 #undef BN_MP_KARATSUBA_SQR_C
 #undef BN_MP_TOOM_MUL_C
 #undef BN_MP_TOOM_SQR_C
 #undef BN_S_MP_KARATSUBA_MUL_C
-#undef BN_S_MP_KARATSUBA_SQR_C
 #undef BN_S_MP_TOOM_MUL_C
 #undef BN_S_MP_TOOM_SQR_C
 /* Dropbear uses its own random source */
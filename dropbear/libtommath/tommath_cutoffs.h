@@ -8,6 +8,7 @@
  */
 
 #define MP_DEFAULT_KARATSUBA_MUL_CUTOFF 80
-#define MP_DEFAULT_KARATSUBA_SQR_CUTOFF 120
+/* dropbear: where comba squaring stops, see tommath_class.h */
+#define MP_DEFAULT_KARATSUBA_SQR_CUTOFF (MP_MAXFAST / 2)
 #define MP_DEFAULT_TOOM_MUL_CUTOFF      350
 #define MP_DEFAULT_TOOM_SQR_CUTOFF      400
@@ -258,11 +258,11 @@ much traffic. */
 
 /* Window size limits. These tend to be a trade-off between memory
    usage and network performance: */
-/* Size of the network receive window. This amount of memory is allocated
-   as a per-channel receive buffer. Increasing this value can make a
-   significant difference to network performance. 24kB was empirically
-   chosen for a 100mbit ethernet network. The value can be altered at
-   runtime with the -W argument. */
+/* Maximum size of the network receive window. Each channel starts with a
+   smaller window and per-channel receive buffer, and grows them up to this
+   size when the link could carry more data. Increasing this value can make
+   a significant difference to network performance on fast or high latency
+   links. The value can be altered at runtime with the -W argument. */
 #ifndef DEFAULT_RECV_WINDOW
 #define DEFAULT_RECV_WINDOW 24576
 #endif
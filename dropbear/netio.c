@@ -3,6 +3,7 @@
 #include "dbutil.h"
 #include "session.h"
 #include "debug.h"
+#include "dbevent.h"
 
 struct dropbear_progress_connection {
 	struct addrinfo *res;
@@ -222,7 +223,7 @@ void remove_connect_pending() {
 }
 
 
-void set_connect_fds(fd_set *writefd) {
+void set_connect_fds() {
 	m_list_elem *iter;
 	iter = ses.conn_pending.first;
 	while (iter) {
@@ -233,7 +234,7 @@ void set_connect_fds(fd_set *writefd) {
 			connect_try_next(c);
 		}
 		if (c->sock >= 0) {
-			FD_SET(c->sock, writefd);
+			dbev_set(c->sock, DBEV_WRITE, DBEV_NO_CHANNEL);
 		} else {
 			/* Final failure */
 			if (!c->errstring) {
@@ -246,17 +247,20 @@ void set_connect_fds(fd_set *writefd) {
 	}
 }
 
-void handle_connect_fds(const fd_set *writefd) {
+void handle_connect_fds() {
 	m_list_elem *iter;
 	for (iter = ses.conn_pending.first; iter; iter = iter->next) {
 		int val;
 		socklen_t vallen = sizeof(val);
 		struct dropbear_progress_connection *c = iter->item;
 
-		if (c->sock < 0 || !FD_ISSET(c->sock, writefd)) {
+		if (c->sock < 0 || !(dbev_ready(c->sock) & DBEV_WRITE)) {
 			continue;
 		}
 
+		/* the callback's owner waits on it from now on */
+		dbev_forget(c->sock);
+
 		TRACE(("handling %s port %s socket %d", c->remotehost, c->remoteport, c->sock));
 
 		if (getsockopt(c->sock, SOL_SOCKET, SO_ERROR, &val, &vallen) != 0) {
@@ -330,7 +334,7 @@ void packet_queue_consume(struct Queue *queue, ssize_t written) {
 		} else {
 			written -= len;
 			dequeue(queue);
-			buf_free(writebuf);
+			packet_buf_free(writebuf);
 		}
 	}
 }
@@ -407,6 +411,40 @@ void set_sock_priority(int sock, enum dropbear_prio prio) {
 
 }
 
+/* Returns how many bytes sock holds unsent, either what is queued now
+ * (TIOCOUTQ) or what the send buffer has room for, whichever is more.
+ * Returns 0 if it isn't known, such as for a client '-J' proxy pipe */
+unsigned int get_sock_sendqueue(int sock) {
+
+	int sndbuf = 0, outq = 0;
+	socklen_t vallen = sizeof(sndbuf);
+
+#if DROPBEAR_FUZZ
+	if (fuzz.fuzzing) {
+		return 0;
+	}
+#endif
+
+	if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, (void*)&sndbuf, &vallen) < 0) {
+		if (errno != ENOTSOCK) {
+			TRACE(("Couldn't get SO_SNDBUF (%s)", strerror(errno)))
+		}
+		return 0;
+	}
+#ifdef __linux__
+	/* Linux doubles the value set, the other half is bookkeeping */
+	sndbuf /= 2;
+#endif
+
+#ifdef TIOCOUTQ
+	if (ioctl(sock, TIOCOUTQ, &outq) < 0) {
+		outq = 0;
+	}
+#endif
+
+	return MAX(MAX(sndbuf, outq), 0);
+}
+
 /* from openssh/canohost.c avoid premature-optimization */
 int get_sock_port(int sock) {
 	struct sockaddr_storage from;
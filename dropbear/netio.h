@@ -13,6 +13,7 @@ enum dropbear_prio {
 
 void set_sock_nodelay(int sock);
 void set_sock_priority(int sock, enum dropbear_prio prio);
+unsigned int get_sock_sendqueue(int sock);
 
 int get_sock_port(int sock);
 void get_socket_address(int fd, char **local_host, char **local_port,
@@ -32,10 +33,10 @@ typedef void(*connect_callback)(int result, int sock, void* data, const char* er
 struct dropbear_progress_connection * connect_remote (const char* remotehost, const char* remoteport,
 	connect_callback cb, void *cb_data, const char* bind_address, const char* bind_port);
 
-/* Sets up for select() */
-void set_connect_fds(fd_set *writefd);
-/* Handles ready sockets after select() */
-void handle_connect_fds(const fd_set *writefd);
+/* Sets up for dbev_wait() */
+void set_connect_fds(void);
+/* Handles ready sockets after dbev_wait() */
+void handle_connect_fds(void);
 /* Cleanup */
 void remove_connect_pending(void);
 
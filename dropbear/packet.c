@@ -32,15 +32,13 @@
 #include "kex.h"
 #include "dbrandom.h"
 #include "service.h"
+#include "netio.h"
 #include "auth.h"
 #include "channel.h"
-#include "netio.h"
 #include "runopts.h"
 
 static int read_packet_init(void);
-static void make_mac(unsigned int seqno, const struct key_context_directional * key_state,
-		buffer * clear_buf, unsigned int clear_len, 
-		unsigned char *output_mac);
+static int read_stream(unsigned char *dest, unsigned int maxlen);
 static int checkmac(void);
 
 /* For exact details see http://www.zlib.net/zlib_tech.html
@@ -62,6 +60,7 @@ void write_packet() {
 	/* 50 is somewhat arbitrary */
 	unsigned int iov_count = 50;
 	struct iovec iov[50];
+	unsigned int queued;
 #else
 	int len;
 	buffer* writebuf;
@@ -96,8 +95,13 @@ void write_packet() {
 	}
 	}
 
+	/* packet_queue_consume() keeps a partially written packet at the
+	head of the queue, the next writev() carries on from its pos */
+	queued = ses.writequeue.count;
 	packet_queue_consume(&ses.writequeue, written);
 	ses.writequeue_len -= written;
+	ses.write_calls++;
+	ses.write_packets += queued - ses.writequeue.count;
 
 	if (written == 0) {
 		ses.remoteclosed();
@@ -129,12 +133,14 @@ void write_packet() {
 	}
 
 	ses.writequeue_len -= written;
+	ses.write_calls++;
 
 	if (written == len) {
 		/* We've finished with the packet, free it */
 		dequeue(&ses.writequeue);
-		buf_free(writebuf);
+		packet_buf_free(writebuf);
 		writebuf = NULL;
+		ses.write_packets++;
 	} else {
 		/* More packet left to write, leave it in the queue for later */
 		buf_incrpos(writebuf, written);
@@ -180,19 +186,11 @@ void read_packet() {
 		 */
 		len = 0;
 	} else {
-		len = read(ses.sock_in, buf_getptr(ses.readbuf, maxlen), maxlen);
-
-		if (len == 0) {
-			ses.remoteclosed();
-		}
+		len = read_stream(buf_getptr(ses.readbuf, maxlen), maxlen);
 
 		if (len < 0) {
-			if (errno == EINTR || errno == EAGAIN) {
-				TRACE2(("leave read_packet: EINTR or EAGAIN"))
-				return;
-			} else {
-				dropbear_exit("Error reading: %s", strerror(errno));
-			}
+			TRACE2(("leave read_packet: EINTR or EAGAIN"))
+			return;
 		}
 
 		buf_incrpos(ses.readbuf, len);
@@ -207,6 +205,85 @@ void read_packet() {
 	TRACE2(("leave read_packet"))
 }
 
+/* Returns 1 if the main loop should read from channels and the socket.
+ * Once the writequeue goes over writequeue_limit reading stops until it
+ * has drained to half of that, so channels are read in bursts rather than
+ * a packet at a time. The limit is taken from the socket's send buffer
+ * each time it fills: there's no point holding much more than the kernel
+ * can accept in one write, but holding less lets the link go idle. */
+int writequeue_has_space() {
+
+	struct timespec now;
+	unsigned int sendqueue;
+
+	if (ses.writequeue_full) {
+		if (ses.writequeue_len <= ses.writequeue_limit / 2) {
+			gettime_wrapper(&now);
+			ses.writequeue_full_ms +=
+				(now.tv_sec - ses.writequeue_full_time.tv_sec) * 1000
+				+ (now.tv_nsec - ses.writequeue_full_time.tv_nsec) / 1000000;
+			ses.writequeue_full = 0;
+		}
+	} else if (ses.writequeue_len > ses.writequeue_limit) {
+		sendqueue = get_sock_sendqueue(ses.sock_out);
+		ses.writequeue_limit = MIN(MAX(sendqueue, WRITEQUEUE_MIN_LIMIT),
+				WRITEQUEUE_MAX_LIMIT);
+		if (ses.writequeue_len > ses.writequeue_limit) {
+			TRACE2(("writequeue full, %u bytes, limit %u",
+				ses.writequeue_len, ses.writequeue_limit))
+			gettime_wrapper(&ses.writequeue_full_time);
+			ses.writequeue_full_count++;
+			ses.writequeue_full = 1;
+		}
+	}
+
+	return !ses.writequeue_full;
+}
+
+/* Returns 1 if ses.readahead holds bytes from the socket that haven't been
+ * passed to read_packet() yet. The main loop calls read_packet() for those
+ * without waiting for the socket to become readable. */
+int packet_readahead_pending() {
+	return ses.readahead != NULL && ses.readahead->pos < ses.readahead->len;
+}
+
+/* Copies up to maxlen bytes of the incoming stream to dest. Bytes come from
+ * ses.readahead, which is refilled with a single large read() once it
+ * has been used up. Returns the number of bytes copied, or -1 if no data
+ * was available (EINTR or EAGAIN) */
+static int read_stream(unsigned char *dest, unsigned int maxlen) {
+
+	int len;
+
+	if (ses.readahead == NULL) {
+		ses.readahead = buf_new(RECV_READAHEAD_LEN);
+	}
+
+	if (!packet_readahead_pending()) {
+		buf_setpos(ses.readahead, 0);
+		buf_setlen(ses.readahead, 0);
+		len = read(ses.sock_in, buf_getwriteptr(ses.readahead, ses.readahead->size),
+				ses.readahead->size);
+		if (len == 0) {
+			ses.remoteclosed();
+		}
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				return -1;
+			}
+			dropbear_exit("Error reading: %s", strerror(errno));
+		}
+		buf_incrwritepos(ses.readahead, len);
+		buf_setpos(ses.readahead, 0);
+		ses.read_calls++;
+	}
+
+	len = MIN(maxlen, ses.readahead->len - ses.readahead->pos);
+	memcpy(dest, buf_getptr(ses.readahead, len), len);
+	buf_incrpos(ses.readahead, len);
+	return len;
+}
+
 /* Function used to read the initial portion of a packet, and determine the
  * length. Only called during the first BLOCKSIZE of a packet. */
 /* Returns DROPBEAR_SUCCESS if the length is determined, 
@@ -225,23 +302,16 @@ static int read_packet_init() {
 
 	if (ses.readbuf == NULL) {
 		/* start of a new packet */
-		ses.readbuf = buf_new(INIT_READBUF);
+		ses.readbuf = packet_buf_new(INIT_READBUF);
 	}
 
 	maxlen = blocksize - ses.readbuf->pos;
 			
 	/* read the rest of the packet if possible */
-	slen = read(ses.sock_in, buf_getwriteptr(ses.readbuf, maxlen),
-			maxlen);
-	if (slen == 0) {
-		ses.remoteclosed();
-	}
+	slen = read_stream(buf_getwriteptr(ses.readbuf, maxlen), maxlen);
 	if (slen < 0) {
-		if (errno == EINTR || errno == EAGAIN) {
-			TRACE2(("leave read_packet_init: EINTR"))
-			return DROPBEAR_FAILURE;
-		}
-		dropbear_exit("Error reading: %s", strerror(errno));
+		TRACE2(("leave read_packet_init: EINTR"))
+		return DROPBEAR_FAILURE;
 	}
 
 	buf_incrwritepos(ses.readbuf, slen);
@@ -265,6 +335,12 @@ static int read_packet_init() {
 		len = plen + 4 + macsize;
 	} else
 #endif
+	if (ses.keys->recv.algo_mac->etm) {
+		/* the length is in the clear, nothing is decrypted until the
+		 * MAC has been checked */
+		plen = buf_getint(ses.readbuf);
+		len = plen + 4 + macsize;
+	} else
 	{
 		if (ses.keys->recv.crypt_mode->decrypt(buf_getptr(ses.readbuf, blocksize), 
 					buf_getwriteptr(ses.readbuf, blocksize),
@@ -287,7 +363,11 @@ static int read_packet_init() {
 	}
 
 	if (len > ses.readbuf->size) {
-		ses.readbuf = buf_resize(ses.readbuf, len);		
+		/* move the first block to a buffer that fits the whole packet */
+		buffer *newbuf = packet_buf_new(len);
+		memcpy(newbuf->data, ses.readbuf->data, blocksize);
+		packet_buf_free(ses.readbuf);
+		ses.readbuf = newbuf;
 	}
 	buf_setlen(ses.readbuf, len);
 	buf_setpos(ses.readbuf, blocksize);
@@ -325,6 +405,25 @@ void decrypt_packet() {
 		buf_incrpos(ses.readbuf, len);
 	} else
 #endif
+	if (ses.keys->recv.algo_mac->etm) {
+		/* check the hmac of the ciphertext first, a bad packet is
+		 * rejected without decrypting anything */
+		if (checkmac() != DROPBEAR_SUCCESS) {
+			dropbear_exit("Integrity error");
+		}
+
+		/* decrypt everything after the packet length in-place */
+		buf_setpos(ses.readbuf, 4);
+		len = ses.readbuf->len - macsize - ses.readbuf->pos;
+		if (ses.keys->recv.crypt_mode->decrypt(
+					buf_getptr(ses.readbuf, len), 
+					buf_getwriteptr(ses.readbuf, len),
+					len,
+					&ses.keys->recv.cipher_state) != CRYPT_OK) {
+			dropbear_exit("Error decrypting");
+		}
+		buf_incrpos(ses.readbuf, len);
+	} else
 	{
 		/* we've already decrypted the first blocksize in read_packet_init */
 		buf_setpos(ses.readbuf, blocksize);
@@ -370,7 +469,7 @@ void decrypt_packet() {
 		ses.payload = buf_decompress(ses.readbuf, len);
 		buf_setpos(ses.payload, 0);
 		ses.payload_beginning = 0;
-		buf_free(ses.readbuf);
+		packet_buf_free(ses.readbuf);
 	} else 
 #endif
 	{
@@ -526,19 +625,36 @@ void maybe_flush_reply_queue() {
 	ses.reply_queue_head = ses.reply_queue_tail = NULL;
 }
 	
+/* Returns the size of a wire buffer for a payload of payload_len bytes */
+static unsigned int packet_writebuf_size(unsigned int payload_len) {
+	unsigned char blocksize, mac_size;
+
+	blocksize = ses.keys->trans.algo_crypt->blocksize;
+	mac_size = ses.keys->trans.algo_mac->hashsize;
+
+	/* Encrypted packet len is payload+5. We need to then make sure
+	 * there is enough space for padding or MIN_PACKET_LEN. 
+	 * Add extra 3 since we need at least 4 bytes of padding */
+	return (payload_len+4+1) 
+		+ MAX(MIN_PACKET_LEN, blocksize) + 3
+	/* add space for the MAC at the end */
+				+ mac_size
+#ifndef DISABLE_ZLIB
+	/* some extra in case 'compression' makes it larger */
+				+ ZLIB_COMPRESS_EXPANSION
+#endif
+	/* and an extra cleartext (stripped before transmission) byte for the
+	 * packet type */
+				+ 1;
+}
+
 /* encrypt the writepayload, putting into writebuf, ready for write_packet()
  * to put on the wire */
 void encrypt_packet() {
 
-	unsigned char padlen;
-	unsigned char blocksize, mac_size;
 	buffer * writebuf; /* the packet which will go on the wire. This is 
 	                      encrypted in-place. */
 	unsigned char packet_type;
-	unsigned int len, encrypt_buf_size;
-	unsigned char mac_bytes[MAX_MAC_LEN];
-
-	time_t now;
 	
 	TRACE2(("enter encrypt_packet()"))
 
@@ -555,26 +671,8 @@ void encrypt_packet() {
 		enqueue_reply_packet();
 		return;
 	}
-		
-	blocksize = ses.keys->trans.algo_crypt->blocksize;
-	mac_size = ses.keys->trans.algo_mac->hashsize;
-
-	/* Encrypted packet len is payload+5. We need to then make sure
-	 * there is enough space for padding or MIN_PACKET_LEN. 
-	 * Add extra 3 since we need at least 4 bytes of padding */
-	encrypt_buf_size = (ses.writepayload->len+4+1) 
-		+ MAX(MIN_PACKET_LEN, blocksize) + 3
-	/* add space for the MAC at the end */
-				+ mac_size
-#ifndef DISABLE_ZLIB
-	/* some extra in case 'compression' makes it larger */
-				+ ZLIB_COMPRESS_EXPANSION
-#endif
-	/* and an extra cleartext (stripped before transmission) byte for the
-	 * packet type */
-				+ 1;
 
-	writebuf = buf_new(encrypt_buf_size);
+	writebuf = packet_buf_new(packet_writebuf_size(ses.writepayload->len));
 	buf_setlen(writebuf, PACKET_PAYLOAD_OFF);
 	buf_setpos(writebuf, PACKET_PAYLOAD_OFF);
 
@@ -595,6 +693,52 @@ void encrypt_packet() {
 	buf_setpos(ses.writepayload, 0);
 	buf_setlen(ses.writepayload, 0);
 
+	encrypt_writebuf(writebuf, packet_type);
+
+	TRACE2(("leave encrypt_packet()"))
+}
+
+/* Returns a buffer that the payload of a packet can be written to directly,
+ * positioned at the start of the payload with room for the packet header,
+ * padding and MAC. Returns NULL if the payload has to go through
+ * ses.writepayload and encrypt_packet() instead (during key exchange, or
+ * with compression). */
+buffer * new_writebuf(unsigned int payload_len) {
+	buffer * writebuf;
+
+	if (!ses.dataallowed) {
+		return NULL;
+	}
+#ifndef DISABLE_ZLIB
+	if (is_compress_trans()) {
+		return NULL;
+	}
+#endif
+
+	writebuf = packet_buf_new(packet_writebuf_size(payload_len));
+	buf_setlen(writebuf, PACKET_PAYLOAD_OFF);
+	buf_setpos(writebuf, PACKET_PAYLOAD_OFF);
+	return writebuf;
+}
+
+/* Adds the length, padding and MAC to a payload starting at
+ * PACKET_PAYLOAD_OFF of writebuf, encrypts it in place and queues it for
+ * write_packet(). The payload must already be compressed if required,
+ * packet_type is its uncompressed first byte. */
+void encrypt_writebuf(buffer * writebuf, unsigned char packet_type) {
+
+	unsigned char padlen;
+	unsigned char blocksize, mac_size;
+	unsigned int len;
+	unsigned char mac_bytes[MAX_MAC_LEN];
+
+	time_t now;
+
+	TRACE2(("enter encrypt_writebuf() type %d", packet_type))
+
+	blocksize = ses.keys->trans.algo_crypt->blocksize;
+	mac_size = ses.keys->trans.algo_mac->hashsize;
+
 	/* length of padding - packet length excluding the packetlength uint32
 	 * field in aead mode must be a multiple of blocksize, with a minimum of
 	 * 4 bytes of padding */
@@ -604,6 +748,9 @@ void encrypt_packet() {
 		len -= 4;
 	}
 #endif
+	if (ses.keys->trans.algo_mac->etm) {
+		len -= 4;
+	}
 	padlen = blocksize - len % blocksize;
 	if (padlen < 4) {
 		padlen += blocksize;
@@ -641,6 +788,23 @@ void encrypt_packet() {
 		buf_incrpos(writebuf, len + mac_size);
 	} else
 #endif
+	if (ses.keys->trans.algo_mac->etm) {
+		/* encrypt everything after the packet length in-place */
+		buf_setpos(writebuf, 4);
+		len = writebuf->len - 4;
+		if (ses.keys->trans.crypt_mode->encrypt(
+					buf_getptr(writebuf, len),
+					buf_getwriteptr(writebuf, len),
+					len,
+					&ses.keys->trans.cipher_state) != CRYPT_OK) {
+			dropbear_exit("Error encrypting");
+		}
+
+		/* then MAC the length and ciphertext */
+		make_mac(ses.transseq, &ses.keys->trans, writebuf, writebuf->len, mac_bytes);
+		buf_setpos(writebuf, writebuf->len);
+		buf_putbytes(writebuf, mac_bytes, mac_size);
+	} else
 	{
 		make_mac(ses.transseq, &ses.keys->trans, writebuf, writebuf->len, mac_bytes);
 
@@ -681,7 +845,7 @@ void encrypt_packet() {
 
 	}
 
-	TRACE2(("leave encrypt_packet()"))
+	TRACE2(("leave encrypt_writebuf()"))
 }
 
 void writebuf_enqueue(buffer * writebuf) {
@@ -692,71 +856,228 @@ void writebuf_enqueue(buffer * writebuf) {
 }
 
 
+/* Returns the freelist index for a buffer of at least size bytes, or -1
+ * if it is larger than the biggest class */
+static int packet_buf_class(unsigned int size) {
+	int i;
+	for (i = 0; i < PACKET_BUF_CLASSES; i++) {
+		if (size <= (PACKET_BUF_MIN << i) + PACKET_BUF_SLACK) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Returns an empty buffer with at least size bytes for a packet. Recycled
+ * buffers aren't zeroed, callers write the contents before reading them */
+buffer * packet_buf_new(unsigned int size) {
+	buffer *buf;
+	int i;
+
+	i = packet_buf_class(size);
+	if (i < 0) {
+		ses.bufpool.misses++;
+		return buf_new(size);
+	}
+
+	buf = ses.bufpool.freelist[i];
+	if (buf == NULL) {
+		ses.bufpool.misses++;
+		return buf_new((PACKET_BUF_MIN << i) + PACKET_BUF_SLACK);
+	}
+
+	/* the freelist link is stored in the unused data */
+	memcpy(&ses.bufpool.freelist[i], buf->data, sizeof(buffer*));
+	ses.bufpool.pooled_bytes -= buf->size;
+	ses.bufpool.hits++;
+	buf->len = 0;
+	buf->pos = 0;
+	return buf;
+}
+
+/* Returns a buffer to the freelists if it is exactly a class size and the
+ * pool has room, otherwise frees it. Any buffer may be passed here */
+void packet_buf_free(buffer * buf) {
+	int i;
+
+	if (buf == NULL) {
+		return;
+	}
+
+	i = packet_buf_class(buf->size);
+	if (i < 0 || buf->size != (PACKET_BUF_MIN << i) + PACKET_BUF_SLACK
+			|| ses.bufpool.pooled_bytes + buf->size > PACKET_BUF_POOL_LEN) {
+		buf_free(buf);
+		return;
+	}
+
+	memcpy(buf->data, &ses.bufpool.freelist[i], sizeof(buffer*));
+	ses.bufpool.freelist[i] = buf;
+	ses.bufpool.pooled_bytes += buf->size;
+	ses.bufpool.peak_pooled_bytes = MAX(ses.bufpool.peak_pooled_bytes,
+			ses.bufpool.pooled_bytes);
+}
+
+/* Frees all pooled packet buffers */
+void packet_buf_cleanup() {
+	buffer *buf;
+	int i;
+
+	TRACE(("packet buffers: %lu hits %lu misses, peak pooled %u bytes",
+		ses.bufpool.hits, ses.bufpool.misses, ses.bufpool.peak_pooled_bytes))
+
+	for (i = 0; i < PACKET_BUF_CLASSES; i++) {
+		while (ses.bufpool.freelist[i] != NULL) {
+			buf = ses.bufpool.freelist[i];
+			memcpy(&ses.bufpool.freelist[i], buf->data, sizeof(buffer*));
+			buf_free(buf);
+		}
+	}
+	ses.bufpool.pooled_bytes = 0;
+}
+
 /* Create the packet mac, and append H(seqno|clearbuf) to the output */
 /* output_mac must have ses.keys->trans.algo_mac->hashsize bytes. */
-static void make_mac(unsigned int seqno, const struct key_context_directional * key_state,
+void make_mac(unsigned int seqno, struct key_context_directional * key_state,
 		buffer * clear_buf, unsigned int clear_len, 
 		unsigned char *output_mac) {
+	const struct ltc_hash_descriptor *hash_desc = key_state->algo_mac->hash_desc;
 	unsigned char seqbuf[4];
-	unsigned long bufsize;
-	hmac_state hmac;
+	unsigned char digest[MAXBLOCKSIZE];
+	hash_state hs;
+
+#if DROPBEAR_UMAC
+	if (key_state->algo_mac->umac) {
+		/* the sequence number is the nonce rather than part of the
+		 * message, as in OpenSSH */
+		unsigned char nonce[8];
+		STORE64H((uint64_t)seqno, nonce);
+		buf_setpos(clear_buf, 0);
+		dropbear_umac(&key_state->mac_state.umac, nonce,
+				buf_getptr(clear_buf, clear_len), clear_len, output_mac);
+		TRACE2(("leave writemac"))
+		return;
+	}
+#endif
 
 	if (key_state->algo_mac->hashsize > 0) {
-		/* calculate the mac */
-		if (hmac_init(&hmac, 
-					key_state->hash_index,
-					key_state->mackey,
-					key_state->algo_mac->keysize) != CRYPT_OK) {
-			dropbear_exit("HMAC error");
-		}
+		/* calculate the mac, starting from the inner state which already
+		 * has the key processed, see gen_mac_states() */
+		hs = key_state->mac_state.hmac.inner;
 	
 		/* sequence number */
 		STORE32H(seqno, seqbuf);
-		if (hmac_process(&hmac, seqbuf, 4) != CRYPT_OK) {
+		if (hash_desc->process(&hs, seqbuf, 4) != CRYPT_OK) {
 			dropbear_exit("HMAC error");
 		}
 	
 		/* the actual contents */
 		buf_setpos(clear_buf, 0);
-		if (hmac_process(&hmac, 
+		if (hash_desc->process(&hs, 
 					buf_getptr(clear_buf, clear_len),
 					clear_len) != CRYPT_OK) {
 			dropbear_exit("HMAC error");
 		}
-	
-		bufsize = MAX_MAC_LEN;
-		if (hmac_done(&hmac, output_mac, &bufsize) != CRYPT_OK) {
+		if (hash_desc->done(&hs, digest) != CRYPT_OK) {
 			dropbear_exit("HMAC error");
 		}
+
+		/* and the outer hash of that */
+		hs = key_state->mac_state.hmac.outer;
+		if (hash_desc->process(&hs, digest, hash_desc->hashsize) != CRYPT_OK
+			|| hash_desc->done(&hs, digest) != CRYPT_OK) {
+			dropbear_exit("HMAC error");
+		}
+
+		memcpy(output_mac, digest, key_state->algo_mac->hashsize);
 	}
 	TRACE2(("leave writemac"))
 }
 
 #ifndef DISABLE_ZLIB
+/* The level to compress the next packet from the source s at. Data that
+ * deflate can't shrink by COMPRESS_MIN_GAIN percent (already compressed or
+ * encrypted) is sent in stored blocks, still a valid zlib@openssh.com
+ * stream but almost free to produce, for opts.compress_probe bytes before
+ * it is sampled again. The stored run doubles each time, up to
+ * COMPRESS_MAX_BACKOFF probe intervals */
+static int compress_level(const struct compress_sample *s) {
+	if (s->stored > 0) {
+		return 0;
+	}
+	return opts.compress_level;
+}
+
+static void compress_update(struct compress_sample *s, int level,
+		unsigned int in, unsigned int out) {
+
+	if (level == 0) {
+		s->stored -= MIN(s->stored, in);
+		return;
+	}
+	if (opts.compress_probe == 0) {
+		return;
+	}
+
+	s->in += in;
+	s->out += out;
+	if (s->in < COMPRESS_SAMPLE) {
+		return;
+	}
+
+	if ((unsigned long long)s->out * 100
+			> (unsigned long long)s->in * (100 - COMPRESS_MIN_GAIN)) {
+		s->backoff = MIN(MAX(s->backoff * 2, 1), COMPRESS_MAX_BACKOFF);
+		s->stored = s->backoff * opts.compress_probe;
+		TRACE(("compress: %u -> %u bytes, stored for %u",
+					s->in, s->out, s->stored))
+	} else {
+		s->backoff = 0;
+	}
+	s->in = s->out = 0;
+}
+
 /* compresses len bytes from src, outputting to dest (starting from the
  * respective current positions. dest must have sufficient space,
  * len+ZLIB_COMPRESS_EXPANSION */
 static void buf_compress(buffer * dest, buffer * src, unsigned int len) {
 
 	unsigned int endpos = src->pos + len;
+	unsigned int startpos = dest->pos;
+	struct compress_sample *sample;
+	z_streamp zstream = ses.keys->trans.zstream;
+	int level;
 	int result;
 
 	TRACE2(("enter buf_compress"))
 
 	dropbear_assert(dest->size - dest->pos >= len+ZLIB_COMPRESS_EXPANSION);
 
-	ses.keys->trans.zstream->avail_in = endpos - src->pos;
-	ses.keys->trans.zstream->next_in = 
-		buf_getptr(src, ses.keys->trans.zstream->avail_in);
+	zstream->avail_out = dest->size - dest->pos;
+	zstream->next_out = buf_getwriteptr(dest, zstream->avail_out);
+
+	sample = ses.compress_chan ? ses.compress_chan : &ses.compress;
+	level = compress_level(sample);
+	if (level != ses.keys->trans.zlevel) {
+		/* The previous packet ended with a sync flush so nothing is
+		 * pending, any output from the switch goes to dest. If zlib
+		 * still refuses the old level is kept */
+		zstream->avail_in = 0;
+		result = deflateParams(zstream, level, Z_DEFAULT_STRATEGY);
+		if (result == Z_OK) {
+			ses.keys->trans.zlevel = level;
+		} else if (result != Z_BUF_ERROR) {
+			dropbear_exit("zlib error");
+		}
+	}
 
-	ses.keys->trans.zstream->avail_out = dest->size - dest->pos;
-	ses.keys->trans.zstream->next_out =
-		buf_getwriteptr(dest, ses.keys->trans.zstream->avail_out);
+	zstream->avail_in = endpos - src->pos;
+	zstream->next_in = buf_getptr(src, zstream->avail_in);
 
-	result = deflate(ses.keys->trans.zstream, Z_SYNC_FLUSH);
+	result = deflate(zstream, Z_SYNC_FLUSH);
 
-	buf_setpos(src, endpos - ses.keys->trans.zstream->avail_in);
-	buf_setlen(dest, dest->size - ses.keys->trans.zstream->avail_out);
+	buf_setpos(src, endpos - zstream->avail_in);
+	buf_setlen(dest, dest->size - zstream->avail_out);
 	buf_setpos(dest, dest->len);
 
 	if (result != Z_OK) {
@@ -764,7 +1085,10 @@ static void buf_compress(buffer * dest, buffer * src, unsigned int len) {
 	}
 
 	/* fails if destination buffer wasn't large enough */
-	dropbear_assert(ses.keys->trans.zstream->avail_in == 0);
+	dropbear_assert(zstream->avail_in == 0);
+
+	compress_update(sample, ses.keys->trans.zlevel, len,
+			dest->pos - startpos);
 	TRACE2(("leave buf_compress"))
 }
 #endif
@@ -32,14 +32,27 @@
 
 void write_packet(void);
 void read_packet(void);
+int packet_readahead_pending(void);
+int writequeue_has_space(void);
 void decrypt_packet(void);
 void encrypt_packet(void);
+buffer * new_writebuf(unsigned int payload_len);
+void encrypt_writebuf(buffer * writebuf, unsigned char packet_type);
 
 void writebuf_enqueue(buffer * writebuf);
 
+buffer * packet_buf_new(unsigned int size);
+void packet_buf_free(buffer * buf);
+void packet_buf_cleanup(void);
+
 void process_packet(void);
 
 void maybe_flush_reply_queue(void);
+
+struct key_context_directional;
+void make_mac(unsigned int seqno, struct key_context_directional * key_state,
+		buffer * clear_buf, unsigned int clear_len,
+		unsigned char *output_mac);
 typedef struct PacketType {
 	unsigned char type; /* SSH_MSG_FOO */
 	void (*handler)(void);
@@ -50,4 +63,32 @@ typedef struct PacketType {
 
 #define INIT_READBUF 128
 
+/* Packet buffers are recycled through per-session freelists, one for each
+ * size class. Class i holds (PACKET_BUF_MIN << i) + PACKET_BUF_SLACK bytes,
+ * the slack covers length, padding, MAC and compression overhead so a
+ * full TRANS_MAX_PAYLOAD_LEN payload still fits a power-of-two class */
+#define PACKET_BUF_MIN 256
+#define PACKET_BUF_SLACK 256
+#define PACKET_BUF_CLASSES 10
+
+struct packet_buf_pool {
+	buffer * freelist[PACKET_BUF_CLASSES];
+	unsigned int pooled_bytes;
+	/* statistics, traced at session cleanup */
+	unsigned int peak_pooled_bytes;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+#ifndef DISABLE_ZLIB
+/* How well one source of outgoing data has been compressing, kept for the
+ * session and for each channel. See compress_level() */
+struct compress_sample {
+	unsigned int in, out; /* bytes of the sample so far */
+	unsigned int stored; /* bytes left to send stored before sampling again */
+	unsigned int backoff; /* length of the last stored run, in probe
+							 intervals */
+};
+#endif
+
 #endif /* DROPBEAR_PACKET_H_ */
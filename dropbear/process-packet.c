@@ -155,7 +155,7 @@ void process_packet() {
 
 out:
 	ses.lastpacket = type;
-	buf_free(ses.payload);
+	packet_buf_free(ses.payload);
 	ses.payload = NULL;
 
 	TRACE2(("leave process_packet"))
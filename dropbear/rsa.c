@@ -45,6 +45,7 @@
 
 static void rsa_pad_em(const dropbear_rsa_key * key,
 	const buffer *data_buf, mp_int * rsa_em, enum signature_type sigtype);
+static void rsa_crt_precompute(dropbear_rsa_key *key);
 
 /* Load a public rsa key from a buffer, initialising the values.
  * The key will have the same format as buf_put_rsa_key.
@@ -59,6 +60,9 @@ int buf_get_rsa_pub_key(buffer* buf, dropbear_rsa_key *key) {
 	key->d = NULL;
 	key->p = NULL;
 	key->q = NULL;
+	key->dP = NULL;
+	key->dQ = NULL;
+	key->qInv = NULL;
 
 	buf_incrpos(buf, 4+SSH_SIGNKEY_RSA_LEN); /* int + "ssh-rsa" */
 
@@ -126,6 +130,8 @@ int buf_get_rsa_priv_key(buffer* buf, dropbear_rsa_key *key) {
 			TRACE(("leave buf_get_rsa_priv_key: q: ret == DROPBEAR_FAILURE"))
 			goto out;
 		}
+
+		rsa_crt_precompute(key);
 	}
 
 	ret = DROPBEAR_SUCCESS;
@@ -136,6 +142,38 @@ out:
 	TRACE(("leave buf_get_rsa_priv_key"))
 	return ret;
 }
+
+/* Derive dP, dQ and qInv so that signing can work mod p and mod q
+ * rather than mod n. Keys with inconsistent p and q are left without
+ * them and sign with d as before */
+static void rsa_crt_precompute(dropbear_rsa_key *key) {
+	DEF_MP_INT(tmp);
+
+	m_mp_init(&tmp);
+	m_mp_alloc_init_multi(&key->dP, &key->dQ, &key->qInv, NULL);
+
+	if (mp_mul(key->p, key->q, &tmp) != MP_OKAY
+		|| mp_cmp(&tmp, key->n) != MP_EQ) {
+		TRACE(("rsa_crt_precompute: p*q != n"))
+		goto fail;
+	}
+
+	if (mp_sub_d(key->p, 1, &tmp) != MP_OKAY
+		|| mp_mod(key->d, &tmp, key->dP) != MP_OKAY
+		|| mp_sub_d(key->q, 1, &tmp) != MP_OKAY
+		|| mp_mod(key->d, &tmp, key->dQ) != MP_OKAY
+		|| mp_invmod(key->q, key->p, key->qInv) != MP_OKAY) {
+		TRACE(("rsa_crt_precompute: failed"))
+		goto fail;
+	}
+
+	mp_clear(&tmp);
+	return;
+
+fail:
+	mp_clear(&tmp);
+	m_mp_free_multi(&key->dP, &key->dQ, &key->qInv, NULL);
+}
 	
 
 /* Clear and free the memory used by a public or private key */
@@ -148,6 +186,7 @@ void rsa_key_free(dropbear_rsa_key *key) {
 		return;
 	}
 	m_mp_free_multi(&key->d, &key->e, &key->p, &key->q, &key->n, NULL);
+	m_mp_free_multi(&key->dP, &key->dQ, &key->qInv, NULL);
 	m_free(key);
 	TRACE2(("leave rsa_key_free"))
 }
@@ -250,6 +289,51 @@ out:
 
 #endif /* DROPBEAR_SIGNKEY_VERIFY */
 
+/* s = m^d mod n. With the CRT values this is two half-size exponentiations
+ * mod p and mod q (Garner's recombination), several times faster than one
+ * mod n. The result is checked with the public exponent so a fault in
+ * either half can't leak p in a bad signature */
+static void rsa_private_op(const dropbear_rsa_key *key, mp_int *m, mp_int *s) {
+	DEF_MP_INT(m1);
+	DEF_MP_INT(m2);
+	DEF_MP_INT(h);
+
+	if (key->dP == NULL) {
+		if (mp_exptmod(m, key->d, key->n, s) != MP_OKAY) {
+			dropbear_exit("RSA error");
+		}
+		return;
+	}
+
+	m_mp_init_multi(&m1, &m2, &h, NULL);
+
+	/* m1 = m^dP mod p, m2 = m^dQ mod q */
+	if (mp_mod(m, key->p, &h) != MP_OKAY
+		|| mp_exptmod(&h, key->dP, key->p, &m1) != MP_OKAY
+		|| mp_mod(m, key->q, &h) != MP_OKAY
+		|| mp_exptmod(&h, key->dQ, key->q, &m2) != MP_OKAY) {
+		dropbear_exit("RSA error");
+	}
+
+	/* h = qInv(m1 - m2) mod p, s = m2 + hq */
+	if (mp_sub(&m1, &m2, &h) != MP_OKAY
+		|| mp_mulmod(&h, key->qInv, key->p, &m1) != MP_OKAY
+		|| mp_mul(&m1, key->q, &h) != MP_OKAY
+		|| mp_add(&h, &m2, s) != MP_OKAY) {
+		dropbear_exit("RSA error");
+	}
+
+	/* s^e mod n must give back m */
+	if (mp_exptmod(s, key->e, key->n, &h) != MP_OKAY) {
+		dropbear_exit("RSA error");
+	}
+	if (mp_cmp(&h, m) != MP_EQ) {
+		dropbear_exit("RSA signature check failed");
+	}
+
+	mp_clear_multi(&m1, &m2, &h, NULL);
+}
+
 /* Sign the data presented with key, writing the signature contents
  * to the buffer */
 void buf_put_rsa_sign(buffer* buf, const dropbear_rsa_key *key, 
@@ -296,9 +380,7 @@ void buf_put_rsa_sign(buffer* buf, const dropbear_rsa_key *key,
 
 	/* rsa_tmp2 is em' */
 	/* s' = (em')^d mod n */
-	if (mp_exptmod(&rsa_tmp2, key->d, key->n, &rsa_tmp1) != MP_OKAY) {
-		dropbear_exit("RSA error");
-	}
+	rsa_private_op(key, &rsa_tmp2, &rsa_tmp1);
 
 	/* rsa_tmp1 is s' */
 	/* rsa_tmp3 is r^(-1) mod n */
@@ -311,9 +393,7 @@ void buf_put_rsa_sign(buffer* buf, const dropbear_rsa_key *key,
 
 	/* s = em^d mod n */
 	/* rsa_tmp1 is em */
-	if (mp_exptmod(&rsa_tmp1, key->d, key->n, &rsa_s) != MP_OKAY) {
-		dropbear_exit("RSA error");
-	}
+	rsa_private_op(key, &rsa_tmp1, &rsa_s);
 
 #endif /* DROPBEAR_RSA_BLINDING */
 
@@ -39,6 +39,11 @@ typedef struct dropbear_RSA_Key {
 	mp_int* d;
 	mp_int* p;
 	mp_int* q;
+	/* CRT values derived from the above when the key is loaded,
+	 * NULL for keys without p and q */
+	mp_int* dP; /* d mod (p-1) */
+	mp_int* dQ; /* d mod (q-1) */
+	mp_int* qInv; /* q^-1 mod p */
 
 } dropbear_rsa_key;
 
@@ -51,6 +51,8 @@ typedef struct runopts {
 		DROPBEAR_COMPRESS_ON,
 		DROPBEAR_COMPRESS_OFF,
 	} compress_mode;
+	int compress_level; /* deflate level, see compress_level() */
+	unsigned int compress_probe; /* bytes, 0 disables the stored fallback */
 #endif
 
 #if DROPBEAR_USER_ALGO_LIST
@@ -65,6 +67,7 @@ extern runopts opts;
 int readhostkey(const char * filename, sign_key * hostkey, 
 	enum signkey_type *type);
 void load_all_hostkeys(void);
+void load_delayed_hostkeys(void);
 
 typedef struct svr_runopts {
 
@@ -43,6 +43,7 @@
 #endif
 #include "gcm.h"
 #include "chachapoly.h"
+#include "umac.h"
 
 void common_session_init(int sock_in, int sock_out);
 void session_loop(void(*loophandler)(void)) ATTRIB_NORETURN;
@@ -60,6 +61,7 @@ void fill_passwd(const char* username);
 void svr_session(int sock, int childpipe) ATTRIB_NORETURN;
 void svr_dropbear_exit(int exitcode, const char* format, va_list param) ATTRIB_NORETURN;
 void svr_dropbear_log(int priority, const char* format, va_list param);
+void svr_algos_initialise(void);
 
 /* Client */
 void cli_session(int sock_in, int sock_out, struct dropbear_progress_connection *progress, pid_t proxy_cmd_pid) ATTRIB_NORETURN;
@@ -74,10 +76,10 @@ struct key_context_directional {
 	const struct dropbear_cipher *algo_crypt;
 	const struct dropbear_cipher_mode *crypt_mode;
 	const struct dropbear_hash *algo_mac;
-	int hash_index; /* lookup for libtomcrypt */
 	int algo_comp; /* compression */
 #ifndef DISABLE_ZLIB
 	z_streamp zstream;
+	int zlevel; /* deflate level zstream is currently at */
 #endif
 	/* actual keys */
 	union {
@@ -95,6 +97,17 @@ struct key_context_directional {
 #endif
 	} cipher_state;
 	unsigned char mackey[MAX_MAC_LEN];
+	union {
+		/* HMAC hash states with the keyed inner and outer pads already
+		 * processed, make_mac() continues from copies of these */
+		struct {
+			hash_state inner;
+			hash_state outer;
+		} hmac;
+#if DROPBEAR_UMAC
+		dropbear_umac_state umac;
+#endif
+	} mac_state;
 	int valid;
 };
 
@@ -135,7 +148,7 @@ struct sshsession {
 	 * by the time any recv_() packet methods are called */
 	char *remoteident;
 
-	int maxfd; /* the maximum file descriptor to check with select() */
+	int maxfd; /* the highest file descriptor in use, closed by child processes */
 
 
 	/* Packet buffers/values etc */
@@ -144,7 +157,23 @@ struct sshsession {
 							 buffer with the packet to send. */
 	struct Queue writequeue; /* A queue of encrypted packets to send */
 	unsigned int writequeue_len; /* Number of bytes pending to send in writequeue */
+	/* Reading stops when writequeue_len goes over writequeue_limit, and
+	 * starts again once it's down to half of that */
+	unsigned int writequeue_limit;
+	int writequeue_full;
+	unsigned long writequeue_full_count; /* How often it filled, and */
+	unsigned long writequeue_full_ms; /* the time spent waiting */
+	struct timespec writequeue_full_time;
+	unsigned long write_calls; /* Number of write syscalls on sock_out, and */
+	unsigned long write_packets; /* packets they completed, for the packets
+									per syscall figure traced at cleanup */
+	unsigned long read_calls; /* Number of read syscalls on sock_in after
+								 the ident string */
+	buffer *readahead; /* Raw bytes read from sock_in that haven't been
+						  copied to readbuf yet, see read_packet() */
 	buffer *readbuf; /* From the wire, decrypted in-place */
+	struct packet_buf_pool bufpool; /* Recycled readbuf and writequeue
+									   buffers, see packet_buf_new() */
 	buffer *payload; /* Post-decompression, the actual SSH packet. 
 						May have extra data at the beginning, will be
 						passed to packet processing functions positioned past
@@ -197,6 +226,12 @@ struct sshsession {
 
 	/* Enables/disables compression */
 	algo_type *compress_algos;
+#ifndef DISABLE_ZLIB
+	/* outgoing packets that aren't channel data */
+	struct compress_sample compress;
+	/* set while a channel's data is passed to encrypt_packet() */
+	struct compress_sample *compress_chan;
+#endif
 
 	/* Other side allows SSH_MSG_EXT_INFO. Currently only set for server */
 	int allow_ext_info;
@@ -218,6 +253,15 @@ struct sshsession {
 	struct Channel ** channels; /* these pointers may be null */
 	unsigned int chansize; /* the number of Channel*s allocated for channels */
 	unsigned int chancount; /* the number of Channel*s in use */
+	/* indexes of channels whose wait events need updating, and a flag
+	 * per index so each is only listed once */
+	unsigned int *chandirty;
+	unsigned char *chanisdirty;
+	unsigned int chandirtycount;
+	int chanreadsopen; /* dataallowed and writequeue space, last iteration */
+	/* whether channels may hold receive buffer memory, see shrinkchannelbufs() */
+	int chanbufsheld;
+	time_t chanbufs_checked;
 	const struct ChanType **chantypes; /* The valid channel types */
 
 	/* TCP priority level for the main "port 22" tcp socket */
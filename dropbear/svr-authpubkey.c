@@ -257,111 +257,329 @@ static void send_msg_userauth_pk_ok(const char* sigalgo, unsigned int sigalgolen
 
 }
 
-static int checkpubkey_line(buffer* line, int line_num, const char* filename,
-		const char* algo, unsigned int algolen,
-		const unsigned char* keyblob, unsigned int keybloblen) {
-	buffer *options_buf = NULL;
-	unsigned int pos, len;
-	int ret = DROPBEAR_FAILURE;
+/* authorized_keys is parsed once into an index of its keys, hashed by key
+ * blob, and only parsed again when the file's inode, size or mtime
+ * change. The listener keeps it current so that sessions start with it. */
+struct authkey {
+	char *algo; /* the key type named on the line */
+	unsigned int algolen;
+	unsigned char *blob; /* the decoded key */
+	unsigned int bloblen;
+	buffer *options; /* NULL if the line has none */
+	int line_num;
+	struct authkey *next; /* in the same bucket, in file order */
+};
+
+struct authkeys_index {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	time_t loaded;
+	unsigned int nbuckets; /* a power of two */
+	struct authkey **buckets;
+};
+
+static struct authkeys_index *authkeys = NULL;
+
+static unsigned int authkey_hash(const unsigned char *blob, unsigned int len) {
+	/* FNV-1a */
+	unsigned int h = 2166136261U;
+	unsigned int i;
+	for (i = 0; i < len; i++) {
+		h = (h ^ blob[i]) * 16777619U;
+	}
+	return h;
+}
 
-	if (line->len < MIN_AUTHKEYS_LINE || line->len > MAX_AUTHKEYS_LINE) {
-		TRACE(("checkpubkey_line: bad line length %d", line->len))
+static void authkey_free(struct authkey *k) {
+	m_free(k->algo);
+	m_free(k->blob);
+	if (k->options) {
+		buf_free(k->options);
+	}
+	m_free(k);
+}
+
+/* Makes an entry for the key at line->pos, which is named algo and
+ * followed by a space and the base64 key. Returns NULL if the key doesn't
+ * decode or is of another type than algo */
+static struct authkey* authkey_new(buffer *line, unsigned int algopos,
+		unsigned int algolen, buffer *options, int line_num) {
+	struct authkey *k = NULL;
+	buffer *decodekey = NULL;
+	unsigned long decodekeylen;
+	unsigned int len, filealgolen;
+
+	/* the base64 data runs up to the next space */
+	buf_setpos(line, algopos + algolen + 1);
+	for (len = 0; line->pos + len < line->len; len++) {
+		if (line->data[line->pos + len] == ' ') {
+			break;
+		}
+	}
+	if (len == 0) {
 		goto out;
 	}
 
-	if (memchr(line->data, 0x0, line->len) != NULL) {
-		TRACE(("checkpubkey_line: bad line has null char"))
+	decodekeylen = len * 2; /* big to be safe */
+	decodekey = buf_new(decodekeylen);
+	if (base64_decode(buf_getptr(line, len), len,
+				buf_getwriteptr(decodekey, decodekey->size),
+				&decodekeylen) != CRYPT_OK) {
+		TRACE(("authkey_new: base64 decode failed"))
 		goto out;
 	}
+	buf_incrlen(decodekey, decodekeylen);
 
-	/* compare the algorithm. +3 so we have enough bytes to read a space and some base64 characters too. */
-	if (line->pos + algolen+3 > line->len) {
+	/* the algo in the key itself has to match too */
+	if (decodekey->len < 4) {
+		goto out;
+	}
+	filealgolen = buf_getint(decodekey);
+	if (filealgolen != algolen || decodekey->len - decodekey->pos < algolen
+			|| memcmp(buf_getptr(decodekey, algolen), &line->data[algopos],
+					algolen) != 0) {
+		TRACE(("authkey_new: algo match failed"))
 		goto out;
 	}
-	/* check the key type */
-	if (strncmp((const char *) buf_getptr(line, algolen), algo, algolen) != 0) {
-		int is_comment = 0;
-		unsigned char *options_start = NULL;
-		int options_len = 0;
-		int escape, quoted;
-		
-		/* skip over any comments or leading whitespace */
-		while (line->pos < line->len) {
-			const char c = buf_getbyte(line);
-			if (c == ' ' || c == '\t') {
-				continue;
-			} else if (c == '#') {
-				is_comment = 1;
-				break;
-			}
-			buf_decrpos(line, 1);
+
+	k = m_malloc(sizeof(*k));
+	k->algo = m_malloc(algolen);
+	memcpy(k->algo, &line->data[algopos], algolen);
+	k->algolen = algolen;
+	k->bloblen = decodekey->len;
+	k->blob = m_malloc(k->bloblen);
+	memcpy(k->blob, decodekey->data, k->bloblen);
+	if (options) {
+		k->options = buf_new(options->len);
+		buf_putbytes(k->options, options->data, options->len);
+	}
+	k->line_num = line_num;
+
+out:
+	if (decodekey) {
+		buf_free(decodekey);
+	}
+	return k;
+}
+
+/* Returns the length of the word at pos, up to a space or the end */
+static unsigned int authkeys_wordlen(const buffer *line, unsigned int pos) {
+	unsigned int len;
+	for (len = 0; pos + len < line->len; len++) {
+		if (line->data[pos + len] == ' ') {
 			break;
 		}
-		if (is_comment) {
-			/* next line */
+	}
+	return len;
+}
+
+/* Reads the keys an authorized_keys line can match, as a list. A line
+ * starting "algo base64" matches a key of that algo without options.
+ * Otherwise the first word is options, followed by "algo base64",
+ * but not for an algo the line starts with. */
+static struct authkey* authkeys_read_line(buffer* line, int line_num) {
+	struct authkey *plain = NULL, *withopts = NULL;
+	buffer *options_buf = NULL;
+	unsigned char *options_start = NULL;
+	unsigned int leadlen, algopos, algolen;
+	int options_len, escape, quoted;
+
+	if (line->len < MIN_AUTHKEYS_LINE || line->len > MAX_AUTHKEYS_LINE) {
+		TRACE(("authkeys_read_line: bad line length %d", line->len))
+		return NULL;
+	}
+
+	if (memchr(line->data, 0x0, line->len) != NULL) {
+		TRACE(("authkeys_read_line: bad line has null char"))
+		return NULL;
+	}
+
+	leadlen = authkeys_wordlen(line, 0);
+	if (leadlen < line->len) {
+		plain = authkey_new(line, 0, leadlen, NULL, line_num);
+	}
+
+	/* skip over any comments or leading whitespace */
+	buf_setpos(line, 0);
+	while (line->pos < line->len) {
+		const char c = buf_getbyte(line);
+		if (c == ' ' || c == '\t') {
+			continue;
+		} else if (c == '#') {
 			goto out;
 		}
+		buf_decrpos(line, 1);
+		break;
+	}
+
+	/* figure out where the options are */
+	options_start = buf_getptr(line, 0);
+	quoted = 0;
+	escape = 0;
+	options_len = 0;
+	while (line->pos < line->len) {
+		const char c = buf_getbyte(line);
+		if (!quoted && (c == ' ' || c == '\t')) {
+			break;
+		}
+		escape = (!escape && c == '\\');
+		if (!escape && c == '"') {
+			quoted = !quoted;
+		}
+		options_len++;
+	}
+
+	algopos = line->pos;
+	algolen = authkeys_wordlen(line, algopos);
+	if (algopos + algolen >= line->len
+			|| (leadlen >= algolen
+				&& memcmp(line->data, &line->data[algopos], algolen) == 0)) {
+		goto out;
+	}
+
+	options_buf = buf_new(options_len);
+	buf_putbytes(options_buf, options_start, options_len);
+	withopts = authkey_new(line, algopos, algolen, options_buf, line_num);
+	buf_free(options_buf);
 
-		/* remember start of options */
-		options_start = buf_getptr(line, 1);
-		quoted = 0;
-		escape = 0;
-		options_len = 0;
-		
-		/* figure out where the options are */
-		while (line->pos < line->len) {
-			const char c = buf_getbyte(line);
-			if (!quoted && (c == ' ' || c == '\t')) {
-				break;
-			}
-			escape = (!escape && c == '\\');
-			if (!escape && c == '"') {
-				quoted = !quoted;
-			}
-			options_len++;
+out:
+	if (plain) {
+		plain->next = withopts;
+		return plain;
+	}
+	return withopts;
+}
+
+static void authkeys_free(struct authkeys_index *idx) {
+	struct authkey *k, *next;
+	unsigned int i;
+
+	if (idx == NULL) {
+		return;
+	}
+	for (i = 0; i < idx->nbuckets; i++) {
+		for (k = idx->buckets[i]; k; k = next) {
+			next = k->next;
+			authkey_free(k);
 		}
-		options_buf = buf_new(options_len);
-		buf_putbytes(options_buf, options_start, options_len);
+	}
+	m_free(idx->buckets);
+	m_free(idx);
+}
 
-		/* compare the algorithm. +3 so we have enough bytes to read a space and some base64 characters too. */
-		if (line->pos + algolen+3 > line->len) {
-			goto out;
+static struct authkeys_index* authkeys_load(FILE *authfile, const struct stat *st) {
+	struct authkeys_index *idx = NULL;
+	struct authkey *keys = NULL, *last = NULL, *k = NULL, **tail = NULL;
+	buffer *line = NULL;
+	unsigned int count = 0, i;
+	int line_num = 0;
+
+	/* read all the keys in file order */
+	line = buf_new(MAX_AUTHKEYS_LINE);
+	while (buf_getline(line, authfile) == DROPBEAR_SUCCESS) {
+		line_num++;
+		k = authkeys_read_line(line, line_num);
+		if (!k) {
+			continue;
 		}
-		if (strncmp((const char *) buf_getptr(line, algolen), algo, algolen) != 0) {
-			goto out;
+		if (last) {
+			last->next = k;
+		} else {
+			keys = k;
+		}
+		for (last = k, count++; last->next; last = last->next) {
+			count++;
 		}
 	}
-	buf_incrpos(line, algolen);
-	
-	/* check for space (' ') character */
-	if (buf_getbyte(line) != ' ') {
-		TRACE(("checkpubkey_line: space character expected, isn't there"))
-		goto out;
+	buf_free(line);
+
+	idx = m_malloc(sizeof(*idx));
+	idx->dev = st->st_dev;
+	idx->ino = st->st_ino;
+	idx->size = st->st_size;
+	idx->mtime = st->st_mtime;
+	idx->loaded = time(NULL);
+	for (idx->nbuckets = 16; idx->nbuckets < count * 2; idx->nbuckets *= 2) {
+		/* a power of two */
+	}
+	idx->buckets = m_malloc(idx->nbuckets * sizeof(*idx->buckets));
+
+	/* keep file order within each bucket */
+	tail = m_malloc(idx->nbuckets * sizeof(*tail));
+	for (k = keys; k; k = keys) {
+		keys = k->next;
+		k->next = NULL;
+		i = authkey_hash(k->blob, k->bloblen) & (idx->nbuckets - 1);
+		if (tail[i]) {
+			tail[i]->next = k;
+		} else {
+			idx->buckets[i] = k;
+		}
+		tail[i] = k;
 	}
+	m_free(tail);
 
-	/* truncate the line at the space after the base64 data */
-	pos = line->pos;
-	for (len = 0; line->pos < line->len; len++) {
-		if (buf_getbyte(line) == ' ') break;
-	}	
-	buf_setpos(line, pos);
-	buf_setlen(line, line->pos + len);
+	TRACE(("authkeys_load: %d keys from %d lines", count, line_num))
+	return idx;
+}
 
-	TRACE(("checkpubkey_line: line pos = %d len = %d", line->pos, line->len))
+/* Brings the index up to date with filename, reading it again if it has
+ * changed. A file modified in the second it was read might be modified
+ * again without its mtime changing, so that is read again too. */
+static void authkeys_update(const char *filename) {
+	struct stat st;
+	FILE *authfile = NULL;
 
-	ret = cmp_base64_key(keyblob, keybloblen, (const unsigned char *) algo, algolen, line, NULL);
+	if (stat(filename, &st) != 0) {
+		authkeys_free(authkeys);
+		authkeys = NULL;
+		return;
+	}
 
-	if (ret == DROPBEAR_SUCCESS && options_buf) {
-		ret = svr_add_pubkey_options(options_buf, line_num, filename);
+	if (authkeys
+			&& authkeys->dev == st.st_dev
+			&& authkeys->ino == st.st_ino
+			&& authkeys->size == st.st_size
+			&& authkeys->mtime == st.st_mtime
+			&& authkeys->loaded > st.st_mtime) {
+		return;
 	}
 
-out:
-	if (options_buf) {
-		buf_free(options_buf);
+	authkeys_free(authkeys);
+	authkeys = NULL;
+
+	authfile = fopen(filename, "r");
+	if (authfile == NULL) {
+		return;
 	}
-	return ret;
+	if (fstat(fileno(authfile), &st) == 0) {
+		authkeys = authkeys_load(authfile, &st);
+	}
+	fclose(authfile);
 }
 
+/* Looks up a key offered by the client. Lines are tried in file order
+ * until one's options are also acceptable */
+static int authkeys_lookup(const struct authkey *k, const char* filename,
+		const char* algo, unsigned int algolen,
+		const unsigned char* keyblob, unsigned int keybloblen) {
+
+	for (; k; k = k->next) {
+		if (k->algolen != algolen || memcmp(k->algo, algo, algolen) != 0
+			|| k->bloblen != keybloblen
+			|| memcmp(k->blob, keyblob, keybloblen) != 0) {
+			continue;
+		}
+		if (!k->options
+			|| svr_add_pubkey_options(k->options, k->line_num, filename)
+				== DROPBEAR_SUCCESS) {
+			return DROPBEAR_SUCCESS;
+		}
+	}
+	return DROPBEAR_FAILURE;
+}
 
 /* Checks whether a specified publickey (and associated algorithm) is an
  * acceptable key for authentication */
@@ -369,12 +587,9 @@ out:
 static int checkpubkey(const char* keyalgo, unsigned int keyalgolen,
 		const unsigned char* keyblob, unsigned int keybloblen) {
 
-	FILE * authfile = NULL;
 	char * filename = NULL;
 	int ret = DROPBEAR_FAILURE;
-	buffer * line = NULL;
 	unsigned int len;
-	int line_num;
 	uid_t origuid;
 	gid_t origgid;
 
@@ -411,7 +626,7 @@ static int checkpubkey(const char* keyalgo, unsigned int keyalgolen,
 	}
 #endif
 
-	authfile = fopen(filename, "r");
+	authkeys_update(filename);
 
 #if DROPBEAR_SVR_MULTIUSER
 	if ((seteuid(origuid)) < 0 ||
@@ -420,44 +635,31 @@ static int checkpubkey(const char* keyalgo, unsigned int keyalgolen,
 	}
 #endif
 
-	if (authfile == NULL) {
-		goto out;
+	if (authkeys) {
+		ret = authkeys_lookup(authkeys->buckets[authkey_hash(keyblob, keybloblen)
+					& (authkeys->nbuckets - 1)],
+				filename, keyalgo, keyalgolen, keyblob, keybloblen);
 	}
-	TRACE(("checkpubkey: opened authorized_keys OK"))
-
-	line = buf_new(MAX_AUTHKEYS_LINE);
-	line_num = 0;
-
-	/* iterate through the lines */
-	do {
-		if (buf_getline(line, authfile) == DROPBEAR_FAILURE) {
-			/* EOF reached */
-			TRACE(("checkpubkey: authorized_keys EOF reached"))
-			break;
-		}
-		line_num++;
-
-		ret = checkpubkey_line(line, line_num, filename, keyalgo, keyalgolen, keyblob, keybloblen);
-		if (ret == DROPBEAR_SUCCESS) {
-			break;
-		}
 
-		/* We continue to the next line otherwise */
-		
-	} while (1);
-
-out:
-	if (authfile) {
-		fclose(authfile);
-	}
-	if (line) {
-		buf_free(line);
-	}
 	m_free(filename);
 	TRACE(("leave checkpubkey: ret=%d", ret))
 	return ret;
 }
 
+/* Reads authorized_keys into the index if it has changed, called by the
+ * listener so that sessions inherit it. With DROPBEAR_SVR_MULTIUSER the
+ * file has to be read as the user logging in, so sessions read it */
+void svr_authkeys_update(void) {
+#if !DROPBEAR_SVR_MULTIUSER
+	unsigned int len = strlen(conf_path) + 40;
+	char *filename = m_malloc(len);
+
+	snprintf(filename, len, "%s/authorized_keys", conf_path);
+	authkeys_update(filename);
+	m_free(filename);
+#endif
+}
+
 
 /* Returns DROPBEAR_SUCCESS if file permissions for pubkeys are ok,
  * DROPBEAR_FAILURE otherwise.
@@ -554,7 +756,14 @@ static int checkfileperm(char * filename) {
 int fuzz_checkpubkey_line(buffer* line, int line_num, char* filename,
 		const char* algo, unsigned int algolen,
 		const unsigned char* keyblob, unsigned int keybloblen) {
-	return checkpubkey_line(line, line_num, filename, algo, algolen, keyblob, keybloblen);
+	struct authkey *keys = authkeys_read_line(line, line_num), *next = NULL;
+	int ret = authkeys_lookup(keys, filename, algo, algolen, keyblob, keybloblen);
+
+	for (; keys; keys = next) {
+		next = keys->next;
+		authkey_free(keys);
+	}
+	return ret;
 }
 #endif
 
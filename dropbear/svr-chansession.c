@@ -146,7 +146,7 @@ static void sesssigchild_handler(int UNUSED(dummy)) {
 
 	TRACE(("enter sigchld handler"))
 
-	/* Make sure that the main select() loop wakes up */
+	/* Make sure that the main loop wakes up */
 	while (1) {
 		/* isserver is just a random byte to write. We can't do anything
 		about an error so should just ignore it */
@@ -249,6 +249,9 @@ static void send_msg_kexdh_reply(mp_int *dh_e, buffer *ecdh_qs) {
 	/* the SSH_MSG_KEXDH_REPLY is done */
 	encrypt_packet();
 
+	/* a prepared keypair for some other kex won't be needed */
+	kex_discard_param();
+
 	TRACE(("leave send_msg_kexdh_reply"))
 }
 
@@ -179,9 +179,21 @@ static void main_noinetd() {
 		fclose(pidfile);
 	}
 
+	/* kex_prepare_likely() needs random numbers before the first accept */
+	seedrandom();
+	/* the algorithms sessions will offer */
+	svr_algos_initialise();
+	kexdh_prepare_tables();
+
 	/* incoming connection select loop */
 	for(;;) {
 
+		/* inherited by the next forked connection */
+		kex_prepare_likely();
+#if DROPBEAR_SVR_PUBKEY_AUTH
+		svr_authkeys_update();
+#endif
+
 		DROPBEAR_FD_ZERO(&fds);
 		
 		/* listening sockets */
@@ -272,6 +284,10 @@ static void main_noinetd() {
 
 			seedrandom();
 
+			/* keys generated by earlier connections, so this one
+			 * inherits them */
+			load_delayed_hostkeys();
+
 			if (pipe(childpipe) < 0) {
 				TRACE(("error creating child pipe"))
 				goto out;
@@ -287,11 +303,15 @@ static void main_noinetd() {
 				goto out;
 			}
 
+			/* also rekeys genrandom(), the parent and child
+			 * mustn't carry on from the same buffered output */
 			addrandom((void*)&fork_ret, sizeof(fork_ret));
 			
 			if (fork_ret > 0) {
 
 				/* parent */
+				/* the child has the prepared keypair now */
+				kex_discard_param();
 				childpipes[conn_idx] = childpipe[0];
 				m_close(childpipe[1]);
 				preauth_addrs[conn_idx] = remote_host;
@@ -29,6 +29,7 @@
 #include "dbutil.h"
 #include "algo.h"
 #include "ecdsa.h"
+#include "curve25519.h"
 
 #include <grp.h>
 
@@ -38,6 +39,9 @@ static void printhelp(const char * progname);
 static void addportandaddress(const char* spec);
 static void loadhostkey(const char *keyfile, int fatal_duplicate);
 static void addhostkey(const char *keyfile);
+#ifndef DISABLE_ZLIB
+static void parse_compress_arg(const char* spec);
+#endif
 
 static void printhelp(const char * progname) {
 
@@ -99,9 +103,15 @@ static void printhelp(const char * progname) {
 #if INETD_MODE
 					"-i		Start for inetd\n"
 #endif
-					"-W <receive_window_buffer> (default %d, larger may be faster, max 1MB)\n"
+					"-W <receive_window_buffer> (default %d, grown up to this as needed, max 8MB)\n"
 					"-K <keepalive>  (0 is never, default %d, in seconds)\n"
 					"-I <idle_timeout>  (0 is never, default %d, in seconds)\n"
+#ifndef DISABLE_ZLIB
+					"-Z <level>[,<probe>]\n"
+					"		zlib level for compressed sessions, 0-9 (default %d).\n"
+					"		Data that doesn't compress is sent uncompressed\n"
+					"		and tried again after <probe> kB (default %d, 0 is never)\n"
+#endif
 #if DROPBEAR_PLUGIN
                                         "-A <authplugin>[,<options>]\n"
                                         "               Enable external public key auth through <authplugin>\n"
@@ -125,7 +135,11 @@ static void printhelp(const char * progname) {
 #endif
 					MAX_AUTH_TRIES,
 					DROPBEAR_MAX_PORTS, DROPBEAR_DEFPORT, DROPBEAR_PIDFILE,
-					DEFAULT_RECV_WINDOW, DEFAULT_KEEPALIVE, DEFAULT_IDLE_TIMEOUT);
+					DEFAULT_RECV_WINDOW, DEFAULT_KEEPALIVE, DEFAULT_IDLE_TIMEOUT
+#ifndef DISABLE_ZLIB
+					, DEFAULT_COMPRESS_LEVEL, DEFAULT_COMPRESS_PROBE
+#endif
+					);
 }
 
 void svr_getopts(int argc, char ** argv) {
@@ -137,6 +151,9 @@ void svr_getopts(int argc, char ** argv) {
 	char* keepalive_arg = NULL;
 	char* idle_timeout_arg = NULL;
 	char* maxauthtries_arg = NULL;
+#ifndef DISABLE_ZLIB
+	char* compress_arg = NULL;
+#endif
 	char* keyfile = NULL;
 	char c;
 #if DROPBEAR_PLUGIN
@@ -176,6 +193,8 @@ void svr_getopts(int argc, char ** argv) {
 
 #ifndef DISABLE_ZLIB
 	opts.compress_mode = DROPBEAR_COMPRESS_DELAYED;
+	opts.compress_level = DEFAULT_COMPRESS_LEVEL;
+	opts.compress_probe = DEFAULT_COMPRESS_PROBE * 1024;
 #endif 
 
 	/* not yet
@@ -273,6 +292,11 @@ void svr_getopts(int argc, char ** argv) {
 				case 'T':
 					next = &maxauthtries_arg;
 					break;
+#ifndef DISABLE_ZLIB
+				case 'Z':
+					next = &compress_arg;
+					break;
+#endif
 #if DROPBEAR_SVR_PASSWORD_AUTH || DROPBEAR_SVR_PAM_AUTH
 				case 's':
 					svr_opts.noauthpass = 1;
@@ -413,6 +437,12 @@ void svr_getopts(int argc, char ** argv) {
 		opts.idle_timeout_secs = val;
 	}
 
+#ifndef DISABLE_ZLIB
+	if (compress_arg) {
+		parse_compress_arg(compress_arg);
+	}
+#endif
+
 	if (svr_opts.forced_command) {
 		dropbear_log(LOG_INFO, "Forced command set to '%s'", svr_opts.forced_command);
 	}
@@ -482,6 +512,35 @@ static void addportandaddress(const char* spec) {
 	}
 }
 
+#ifndef DISABLE_ZLIB
+/* -Z level[,probe], probe is in kB */
+static void parse_compress_arg(const char* spec) {
+	char *spec_copy = NULL, *probe = NULL;
+	unsigned int val;
+
+	spec_copy = m_strdup(spec);
+	probe = strchr(spec_copy, ',');
+	if (probe) {
+		probe[0] = '\0';
+		probe++;
+	}
+
+	if (m_str_to_uint(spec_copy, &val) == DROPBEAR_FAILURE || val > 9) {
+		dropbear_exit("Bad compression level '%s'", spec);
+	}
+	opts.compress_level = val;
+
+	if (probe) {
+		if (m_str_to_uint(probe, &val) == DROPBEAR_FAILURE
+				|| val > MAX_COMPRESS_PROBE) {
+			dropbear_exit("Bad compression probe '%s'", spec);
+		}
+		opts.compress_probe = val * 1024;
+	}
+	m_free(spec_copy);
+}
+#endif
+
 static void disablekey(int type) {
 	int i;
 	TRACE(("Disabling key type %d", type))
@@ -493,6 +552,17 @@ static void disablekey(int type) {
 	}
 }
 
+/* Whether disablekey() has left type enabled */
+static int keyenabled(int type) {
+	int i;
+	for (i = 0; sigalgs[i].name != NULL; i++) {
+		if (sigalgs[i].val == type) {
+			return sigalgs[i].usable;
+		}
+	}
+	return 1;
+}
+
 static void loadhostkey_helper(const char *name, void** src, void** dst, int fatal_duplicate) {
 	if (*dst) {
 		if (fatal_duplicate) {
@@ -564,6 +634,22 @@ static void addhostkey(const char *keyfile) {
 }
 
 
+/* The default hostkey paths, built once by load_all_hostkeys(). In some
+ * builds the *_PRIV_FILENAME macros allocate a new string each time, and
+ * load_delayed_hostkeys() runs for every connection */
+#if DROPBEAR_RSA
+static const char *rsa_priv_filename;
+#endif
+#if DROPBEAR_DSS
+static const char *dss_priv_filename;
+#endif
+#if DROPBEAR_ECDSA
+static const char *ecdsa_priv_filename;
+#endif
+#if DROPBEAR_ED25519
+static const char *ed25519_priv_filename;
+#endif
+
 void load_all_hostkeys() {
 	int i;
 	int any_keys = 0;
@@ -582,18 +668,22 @@ void load_all_hostkeys() {
 	/* Only load default host keys if a host key is not specified by the user */
 	if (svr_opts.num_hostkey_files == 0) {
 #if DROPBEAR_RSA
-		loadhostkey(RSA_PRIV_FILENAME, 0);
+		rsa_priv_filename = RSA_PRIV_FILENAME;
+		loadhostkey(rsa_priv_filename, 0);
 #endif
 
 #if DROPBEAR_DSS
-		loadhostkey(DSS_PRIV_FILENAME, 0);
+		dss_priv_filename = DSS_PRIV_FILENAME;
+		loadhostkey(dss_priv_filename, 0);
 #endif
 
 #if DROPBEAR_ECDSA
-		loadhostkey(ECDSA_PRIV_FILENAME, 0);
+		ecdsa_priv_filename = ECDSA_PRIV_FILENAME;
+		loadhostkey(ecdsa_priv_filename, 0);
 #endif
 #if DROPBEAR_ED25519
-		loadhostkey(ED25519_PRIV_FILENAME, 0);
+		ed25519_priv_filename = ED25519_PRIV_FILENAME;
+		loadhostkey(ed25519_priv_filename, 0);
 #endif
 	}
 
@@ -663,6 +753,9 @@ void load_all_hostkeys() {
 		disablekey(DROPBEAR_SIGNKEY_ED25519);
 	} else {
 		any_keys = 1;
+		/* Build the signing table once here, rather than in every
+		 * forked connection */
+		dropbear_ed25519_precompute();
 	}
 #endif
 
@@ -670,3 +763,57 @@ void load_all_hostkeys() {
 		dropbear_exit("No hostkeys available. 'dropbear -R' may be useful or run dropbearkey.");
 	}
 }
+
+/* With -R, hostkeys that were missing at startup are generated by the
+ * first connection that needs them. Called by the listener before it
+ * forks, so later connections inherit the parsed key rather than
+ * reading the file again */
+void load_delayed_hostkeys() {
+#if DROPBEAR_DELAY_HOSTKEY
+	struct stat st;
+
+	if (!svr_opts.delay_hostkey || svr_opts.num_hostkey_files > 0) {
+		return;
+	}
+
+#if DROPBEAR_RSA
+	if (!svr_opts.hostkey->rsakey && keyenabled(DROPBEAR_SIGNKEY_RSA)
+			&& stat(rsa_priv_filename, &st) == 0) {
+		loadhostkey(rsa_priv_filename, 0);
+	}
+#endif
+#if DROPBEAR_DSS
+	if (!svr_opts.hostkey->dsskey && keyenabled(DROPBEAR_SIGNKEY_DSS)
+			&& stat(dss_priv_filename, &st) == 0) {
+		loadhostkey(dss_priv_filename, 0);
+	}
+#endif
+#if DROPBEAR_ECDSA
+	/* load_all_hostkeys() leaves at most one size enabled */
+	if (0
+#if DROPBEAR_ECC_256
+		|| (!svr_opts.hostkey->ecckey256
+			&& keyenabled(DROPBEAR_SIGNKEY_ECDSA_NISTP256))
+#endif
+#if DROPBEAR_ECC_384
+		|| (!svr_opts.hostkey->ecckey384
+			&& keyenabled(DROPBEAR_SIGNKEY_ECDSA_NISTP384))
+#endif
+#if DROPBEAR_ECC_521
+		|| (!svr_opts.hostkey->ecckey521
+			&& keyenabled(DROPBEAR_SIGNKEY_ECDSA_NISTP521))
+#endif
+		) {
+		if (stat(ecdsa_priv_filename, &st) == 0) {
+			loadhostkey(ecdsa_priv_filename, 0);
+		}
+	}
+#endif
+#if DROPBEAR_ED25519
+	if (!svr_opts.hostkey->ed25519key && keyenabled(DROPBEAR_SIGNKEY_ED25519)
+			&& stat(ed25519_priv_filename, &st) == 0) {
+		loadhostkey(ed25519_priv_filename, 0);
+	}
+#endif
+#endif /* DROPBEAR_DELAY_HOSTKEY */
+}
@@ -43,7 +43,6 @@
 #include "fuzz.h"
 
 static void svr_remoteclosed(void);
-static void svr_algos_initialise(void);
 
 struct serversession svr_ses; /* GLOBAL */
 
@@ -329,7 +328,7 @@ static void svr_remoteclosed() {
 
 }
 
-static void svr_algos_initialise(void) {
+void svr_algos_initialise(void) {
 	algo_type *algo;
 	for (algo = sshkex; algo->name; algo++) {
 #if DROPBEAR_DH_GROUP1 && DROPBEAR_DH_GROUP1_CLIENTONLY
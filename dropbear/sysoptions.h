@@ -184,13 +184,54 @@ If you test it please contact the Dropbear author */
 
 #define RECV_MAX_PACKET_LEN (MAX(35000, ((RECV_MAX_PAYLOAD_LEN)+100)))
 
+/* read_packet() fills a buffer of this size with a single read() from the
+ * socket, so that bulk transfers parse many packets per syscall */
+#ifndef RECV_READAHEAD_LEN
+#define RECV_READAHEAD_LEN (256*1024)
+#endif
+
+/* Upper limit of memory held in the per-session freelists of packet
+ * buffers, see packet_buf_free() */
+#ifndef PACKET_BUF_POOL_LEN
+#define PACKET_BUF_POOL_LEN (256*1024)
+#endif
+
+/* session_loop() stops reading channels once this much is queued to send,
+ * until half of it has been written. The limit follows the socket's send
+ * buffer, within these bounds. See writequeue_has_space() */
+#ifndef WRITEQUEUE_MIN_LIMIT
+#define WRITEQUEUE_MIN_LIMIT (2*TRANS_MAX_PAYLOAD_LEN)
+#endif
+#ifndef WRITEQUEUE_MAX_LIMIT
+#define WRITEQUEUE_MAX_LIMIT (1024*1024)
+#endif
+
 /* for channel code */
 #define TRANS_MAX_WINDOW 500000000 /* 500MB is sufficient, stopping overflow */
 #define TRANS_MAX_WIN_INCR 500000000 /* overflow prevention */
 
-#define RECV_WINDOWEXTEND (opts.recv_window / 3) /* We send a "window extend" every
-								RECV_WINDOWEXTEND bytes */
-#define MAX_RECV_WINDOW (1024*1024) /* 1 MB should be enough */
+#define RECV_WINDOWEXTEND(channel) ((channel)->recvwinsize / 3) /* We send a
+							"window extend" every RECV_WINDOWEXTEND bytes */
+#define MAX_RECV_WINDOW (8*1024*1024) /* memory is only used by channels that
+										need it, see RECV_INITIAL_WINDOW */
+
+/* Channels start with this receive window (or opts.recv_window if it's
+ * smaller) and grow it towards opts.recv_window when the peer is
+ * limited by the window rather than by the link or by the local side
+ * draining the data */
+#ifndef RECV_INITIAL_WINDOW
+#define RECV_INITIAL_WINDOW (64*1024)
+#endif
+
+/* Channel receive buffers are allocated when data has to be queued, in
+ * steps of CBUF_ALLOC_CHUNK, and freed once they have been empty with no
+ * data received for CHANNEL_BUF_IDLE_SECS */
+#ifndef CBUF_ALLOC_CHUNK
+#define CBUF_ALLOC_CHUNK (16*1024)
+#endif
+#ifndef CHANNEL_BUF_IDLE_SECS
+#define CHANNEL_BUF_IDLE_SECS 5
+#endif
 
 #define MAX_CHANNELS 1000 /* simple mem restriction, includes each tcp/x11
 							connection, so can't be _too_ small */
@@ -205,6 +246,13 @@ If you test it please contact the Dropbear author */
 
 #define MAX_HOSTKEYS 4
 
+/* Rows of the fixed-base table used for g^x in the DH groups, built by
+ * the listener. It holds 2^DH_BASE_TABLE_ROWS values the size of p,
+ * about 70kB for group14 with 8. 0 disables the table */
+#ifndef DH_BASE_TABLE_ROWS
+#define DH_BASE_TABLE_ROWS 8
+#endif
+
 /* The maximum size of the bignum portion of the kexhash buffer */
 /* Sect. 8 of the transport rfc 4253, K_S + e + f + K */
 #define KEXHASHBUF_MAX_INTS (1700 + 130 + 130 + 130)
@@ -221,6 +269,9 @@ If you test it please contact the Dropbear author */
 
 #define DROPBEAR_AES ((DROPBEAR_AES256) || (DROPBEAR_AES128))
 
+#define DROPBEAR_UMAC ((DROPBEAR_UMAC_ETM) && (DROPBEAR_AES) \
+	&& (DROPBEAR_ENABLE_ETM_MODE))
+
 #define DROPBEAR_TWOFISH ((DROPBEAR_TWOFISH256) || (DROPBEAR_TWOFISH128))
 
 #define DROPBEAR_AEAD_MODE ((DROPBEAR_CHACHA20POLY1305) || (DROPBEAR_ENABLE_GCM_MODE))
@@ -245,6 +296,22 @@ If you test it please contact the Dropbear author */
  * with flushing compressed data */
 #define DROPBEAR_ZLIB_MEM_LEVEL 8
 
+/* Compressed outgoing data is sampled COMPRESS_SAMPLE bytes at a time, if
+ * deflate saved less than COMPRESS_MIN_GAIN percent it is sent stored for
+ * the probe interval, doubled each time it still doesn't compress up to
+ * COMPRESS_MAX_BACKOFF intervals */
+#ifndef COMPRESS_SAMPLE
+#define COMPRESS_SAMPLE (64*1024)
+#endif
+#ifndef COMPRESS_MIN_GAIN
+#define COMPRESS_MIN_GAIN 5
+#endif
+#ifndef COMPRESS_MAX_BACKOFF
+#define COMPRESS_MAX_BACKOFF 16
+#endif
+/* largest -Z probe interval in kB, keeps the stored run within an int */
+#define MAX_COMPRESS_PROBE (64*1024)
+
 #if (DROPBEAR_SVR_PASSWORD_AUTH) && (DROPBEAR_SVR_PAM_AUTH)
 #error "You can't turn on PASSWORD and PAM auth both at once. Fix it in localoptions.h"
 #endif
@@ -0,0 +1,255 @@
+/*
+ * Dropbear SSH
+ * 
+ * Copyright (c) 2002,2003 Matt Johnston
+ * All rights reserved.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. */
+
+/* UMAC message authentication as specified in RFC 4418, used for the
+ * umac-64-etm@openssh.com and umac-128-etm@openssh.com MACs. Only the
+ * 64 and 128 bit tag lengths are implemented, and messages are limited to
+ * 2^24 bytes (the L2 hash doesn't switch to its 128 bit polynomial), which
+ * is plenty for SSH packets. */
+
+#include "includes.h"
+#include "dbutil.h"
+#include "umac.h"
+
+#if DROPBEAR_UMAC
+
+#define P36 0x0000000ffffffffbULL /* 2^36 - 5 */
+#define M36 0x0000000fffffffffULL
+#define P64 0xffffffffffffffc5ULL /* 2^64 - 59 */
+#define POLY_KEY_MASK 0x01ffffff01ffffffULL
+
+/* KDF(K, index, len) from the RFC: AES in counter mode over
+ * index || counter, each as a 64 bit big endian value */
+static void umac_kdf(symmetric_key *aes, unsigned char index,
+		unsigned char *out, unsigned int len) {
+	unsigned char in[16], block[16];
+	ulong64 i;
+
+	memset(in, 0x0, sizeof(in));
+	in[7] = index;
+	for (i = 1; len > 0; i++) {
+		unsigned int n = MIN(len, sizeof(block));
+		STORE64H(i, &in[8]);
+		aes_ecb_encrypt(in, block, aes);
+		memcpy(out, block, n);
+		out += n;
+		len -= n;
+	}
+	m_burn(block, sizeof(block));
+}
+
+void dropbear_umac_setup(dropbear_umac_state *state,
+		const unsigned char *key, unsigned int taglen) {
+	symmetric_key aes;
+	unsigned char buf[sizeof(state->nh_key)];
+	unsigned int streams = taglen / 4;
+	unsigned int i, j;
+
+	dropbear_assert(taglen == 8 || taglen == 16);
+	memset(state, 0x0, sizeof(*state));
+	state->taglen = taglen;
+
+	if (aes_setup(key, UMAC_KEY_LEN, 0, &aes) != CRYPT_OK) {
+		dropbear_exit("Error initialising UMAC");
+	}
+
+	/* L1 (NH) key, stored as native integers */
+	umac_kdf(&aes, 1, buf, UMAC_L1_KEY_LEN + 16*(streams-1));
+	for (i = 0; i < (UMAC_L1_KEY_LEN + 16*(streams-1))/4; i++) {
+		LOAD32H(state->nh_key[i], &buf[4*i]);
+	}
+
+	/* L2 (polynomial) key, 24 bytes per stream of which only the
+	 * 64 bit part is used */
+	umac_kdf(&aes, 2, buf, 24*streams);
+	for (i = 0; i < streams; i++) {
+		LOAD64H(state->poly_key[i], &buf[24*i]);
+		state->poly_key[i] &= POLY_KEY_MASK;
+	}
+
+	/* L3 inner product key, 64 bytes per stream. The first half
+	 * multiplies the upper 64 bits of the L2 output, which are always
+	 * zero for the message lengths handled here */
+	umac_kdf(&aes, 3, buf, 64*streams);
+	for (i = 0; i < streams; i++) {
+		for (j = 0; j < 4; j++) {
+			LOAD64H(state->ip_key[i][j], &buf[64*i + 32 + 8*j]);
+			state->ip_key[i][j] %= P36;
+		}
+	}
+	umac_kdf(&aes, 4, buf, 4*streams);
+	for (i = 0; i < streams; i++) {
+		LOAD32H(state->ip_trans[i], &buf[4*i]);
+	}
+
+	/* PDF key, the cache starts off matching the all-zero nonce */
+	umac_kdf(&aes, 0, buf, UMAC_KEY_LEN);
+	if (aes_setup(buf, UMAC_KEY_LEN, 0, &state->pdf_key) != CRYPT_OK) {
+		dropbear_exit("Error initialising UMAC");
+	}
+	aes_ecb_encrypt(state->pdf_nonce, state->pdf_cache, &state->pdf_key);
+
+	m_burn(buf, sizeof(buf));
+	m_burn(&aes, sizeof(aes));
+}
+
+/* NH over one chunk of at most UMAC_L1_KEY_LEN bytes for all streams at
+ * once, plus the chunk's length in bits. The message words are loaded up
+ * front so that the inner loop is straight 32x32->64 multiply-accumulate
+ * over arrays, which compilers turn into SIMD code. */
+static void umac_nh(const dropbear_umac_state *state, const unsigned char *in,
+		unsigned int len, uint64_t *out) {
+	uint32_t m[UMAC_L1_KEY_LEN/4];
+	unsigned int words, full, i, s;
+
+	/* zero pad to a multiple of 32 bytes, an empty message is
+	 * hashed as 32 zero bytes */
+	words = MAX((len + 31) / 32, 1) * 8;
+	full = len / 4;
+	for (i = 0; i < full; i++) {
+		LOAD32L(m[i], &in[4*i]);
+	}
+	if (len % 4) {
+		unsigned char tail[4] = {0};
+		memcpy(tail, &in[4*full], len % 4);
+		LOAD32L(m[full], tail);
+		full++;
+	}
+	for (i = full; i < words; i++) {
+		m[i] = 0;
+	}
+
+	for (s = 0; s < state->taglen / 4; s++) {
+		const uint32_t *k = &state->nh_key[4*s];
+		uint64_t h = 0;
+		for (i = 0; i < words; i += 8) {
+			h += (uint64_t)(uint32_t)(m[i+0] + k[i+0]) * (uint32_t)(m[i+4] + k[i+4]);
+			h += (uint64_t)(uint32_t)(m[i+1] + k[i+1]) * (uint32_t)(m[i+5] + k[i+5]);
+			h += (uint64_t)(uint32_t)(m[i+2] + k[i+2]) * (uint32_t)(m[i+6] + k[i+6]);
+			h += (uint64_t)(uint32_t)(m[i+3] + k[i+3]) * (uint32_t)(m[i+7] + k[i+7]);
+		}
+		out[s] = h + (uint64_t)len * 8;
+	}
+}
+
+/* cur * key + data mod 2^64 - 59, key is masked so the partial
+ * products can't overflow */
+static uint64_t umac_poly64(uint64_t cur, uint64_t key, uint64_t data) {
+	uint32_t key_hi = (uint32_t)(key >> 32), key_lo = (uint32_t)key;
+	uint32_t cur_hi = (uint32_t)(cur >> 32), cur_lo = (uint32_t)cur;
+	uint64_t x, t, res;
+
+	x = (uint64_t)key_hi * cur_lo + (uint64_t)cur_hi * key_lo;
+	res = ((uint64_t)key_hi * cur_hi + (uint32_t)(x >> 32)) * 59
+		+ (uint64_t)key_lo * cur_lo;
+	t = x << 32;
+	res += t;
+	if (res < t) {
+		res += 59;
+	}
+	res += data;
+	if (res < data) {
+		res += 59;
+	}
+	return res;
+}
+
+static void umac_poly(uint64_t *accum, uint64_t key, uint64_t data) {
+	/* values outside the field are encoded as a marker and offset */
+	if ((uint32_t)(data >> 32) == 0xffffffff) {
+		*accum = umac_poly64(*accum, key, P64 - 1);
+		*accum = umac_poly64(*accum, key, data - 59);
+	} else {
+		*accum = umac_poly64(*accum, key, data);
+	}
+}
+
+/* L3: inner product of the 16 bit pieces mod 2^36 - 5 */
+static uint32_t umac_ip(const uint64_t *key, uint64_t data, uint32_t trans) {
+	uint64_t t;
+
+	t = key[0] * (uint16_t)(data >> 48)
+		+ key[1] * (uint16_t)(data >> 32)
+		+ key[2] * (uint16_t)(data >> 16)
+		+ key[3] * (uint16_t)data;
+	t = (t & M36) + 5 * (t >> 36);
+	if (t >= P36) {
+		t -= P36;
+	}
+	return (uint32_t)t ^ trans;
+}
+
+/* Computes the UMAC tag of len bytes from in, nonce is 8 bytes */
+void dropbear_umac(dropbear_umac_state *state, const unsigned char *nonce,
+		const unsigned char *in, unsigned int len, unsigned char *tag) {
+	uint64_t nh[UMAC_MAX_STREAMS];
+	uint64_t accum[UMAC_MAX_STREAMS];
+	unsigned int streams = state->taglen / 4;
+	unsigned int s, index = 0;
+
+	/* UHASH */
+	if (len <= UMAC_L1_KEY_LEN) {
+		/* short messages skip the L2 hash */
+		umac_nh(state, in, len, accum);
+	} else {
+		for (s = 0; s < streams; s++) {
+			accum[s] = 1;
+		}
+		while (len > 0) {
+			unsigned int chunk = MIN(len, UMAC_L1_KEY_LEN);
+			umac_nh(state, in, chunk, nh);
+			for (s = 0; s < streams; s++) {
+				umac_poly(&accum[s], state->poly_key[s], nh[s]);
+			}
+			in += chunk;
+			len -= chunk;
+		}
+		for (s = 0; s < streams; s++) {
+			if (accum[s] >= P64) {
+				accum[s] -= P64;
+			}
+		}
+	}
+	for (s = 0; s < streams; s++) {
+		uint32_t y = umac_ip(state->ip_key[s], accum[s], state->ip_trans[s]);
+		STORE32H(y, &tag[4*s]);
+	}
+
+	/* PDF. For 64 bit tags the low nonce bit selects which half of
+	 * the AES block to use */
+	if (state->taglen == 8) {
+		index = nonce[7] & 1;
+	}
+	if (memcmp(state->pdf_nonce, nonce, 7) != 0
+			|| state->pdf_nonce[7] != (nonce[7] & ~index)) {
+		memcpy(state->pdf_nonce, nonce, 8);
+		state->pdf_nonce[7] &= ~index;
+		aes_ecb_encrypt(state->pdf_nonce, state->pdf_cache, &state->pdf_key);
+	}
+	for (s = 0; s < state->taglen; s++) {
+		tag[s] ^= state->pdf_cache[index*state->taglen + s];
+	}
+}
+
+#endif /* DROPBEAR_UMAC */
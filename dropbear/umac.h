@@ -0,0 +1,60 @@
+/*
+ * Dropbear SSH
+ * 
+ * Copyright (c) 2002,2003 Matt Johnston
+ * All rights reserved.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. */
+
+#ifndef DROPBEAR_DROPBEAR_UMAC_H_
+#define DROPBEAR_DROPBEAR_UMAC_H_
+
+#include "includes.h"
+#include "algo.h"
+
+#if DROPBEAR_UMAC
+
+#define UMAC_KEY_LEN 16
+/* NH processes the message in chunks of this many bytes */
+#define UMAC_L1_KEY_LEN 1024
+/* umac-128 runs four 32-bit hash streams, umac-64 two */
+#define UMAC_MAX_STREAMS 4
+
+typedef struct {
+	unsigned int taglen;
+	/* each stream uses the NH key shifted along by 16 bytes */
+	uint32_t nh_key[(UMAC_L1_KEY_LEN + 16*(UMAC_MAX_STREAMS-1))/4];
+	uint64_t poly_key[UMAC_MAX_STREAMS];
+	uint64_t ip_key[UMAC_MAX_STREAMS][4];
+	uint32_t ip_trans[UMAC_MAX_STREAMS];
+	symmetric_key pdf_key;
+	/* umac-64 gets two consecutive pads from each AES block,
+	 * the last block is cached */
+	unsigned char pdf_nonce[16];
+	unsigned char pdf_cache[16];
+} dropbear_umac_state;
+
+void dropbear_umac_setup(dropbear_umac_state *state,
+		const unsigned char *key, unsigned int taglen);
+void dropbear_umac(dropbear_umac_state *state, const unsigned char *nonce,
+		const unsigned char *in, unsigned int len, unsigned char *tag);
+
+#endif /* DROPBEAR_UMAC */
+
+#endif /* DROPBEAR_DROPBEAR_UMAC_H_ */
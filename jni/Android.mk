@@ -37,6 +37,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/gensignkey.c \
 	$(DROPBEAR_PATH)/keyimport.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/ciphers/aes/aes.c \
+	$(DROPBEAR_PATH)/libtomcrypt/src/ciphers/aes/aes_accel.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/ciphers/anubis.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/ciphers/blowfish.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/ciphers/cast5.c \
@@ -64,6 +65,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/eax/eax_encrypt_authenticate_memory.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/eax/eax_init.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/eax/eax_test.c \
+	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/gcm/gcm_accel.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/gcm/gcm_add_aad.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/gcm/gcm_add_iv.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/encauth/gcm/gcm_done.c \
@@ -295,6 +297,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_mul2add.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_mulmod.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_mulmod_timing.c \
+	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_nistp.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_points.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_projective_add_point.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/pk/ecc/ltc_ecc_projective_dbl_point.c \
@@ -330,6 +333,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/prngs/sober128.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/prngs/sprng.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/prngs/yarrow.c \
+	$(DROPBEAR_PATH)/libtomcrypt/src/stream/chacha/chacha_accel.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/stream/chacha/chacha_crypt.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/stream/chacha/chacha_ivctr64.c \
 	$(DROPBEAR_PATH)/libtomcrypt/src/stream/chacha/chacha_keystream.c \
@@ -437,6 +441,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_get_bit.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_invmod_fast.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_invmod_slow.c \
+	$(DROPBEAR_PATH)/libtommath/bn_s_mp_karatsuba_sqr.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_montgomery_reduce_fast.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_mul_digs.c \
 	$(DROPBEAR_PATH)/libtommath/bn_s_mp_mul_digs_fast.c \
@@ -452,6 +457,7 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/loginrec.c \
 	$(DROPBEAR_PATH)/ltc_prng.c \
 	$(DROPBEAR_PATH)/netio.c \
+	$(DROPBEAR_PATH)/dbevent.c \
 	$(DROPBEAR_PATH)/packet.c \
 	$(DROPBEAR_PATH)/process-packet.c \
 	$(DROPBEAR_PATH)/progressmeter.c \
@@ -473,11 +479,17 @@ DROPBEAR_SRCS := $(DROPBEAR_PATH)/atomicio.c \
 	$(DROPBEAR_PATH)/svr-tcpfwd.c \
 	$(DROPBEAR_PATH)/svr-x11fwd.c \
 	$(DROPBEAR_PATH)/tcp-accept.c \
-	$(DROPBEAR_PATH)/termcodes.c
+	$(DROPBEAR_PATH)/termcodes.c \
+	$(DROPBEAR_PATH)/umac.c
 
 LOCAL_SRC_FILES := interface.c $(DROPBEAR_SRCS)
 LOCAL_C_INCLUDES:= dropbear dropbear/libtomcrypt/src/headers dropbear/libtommath
 LOCAL_LDLIBS    := -lz
+# AES instructions for libtomcrypt, only used when the CPU has them
+ifeq ($(TARGET_ARCH_ABI),arm64-v8a)
+LOCAL_CFLAGS    += -march=armv8-a+crypto
+endif
+DROPBEAR_CFLAGS := $(LOCAL_CFLAGS)
 
 include $(BUILD_SHARED_LIBRARY)
 
@@ -620,3 +632,28 @@ LOCAL_SRC_FILES := buffersu.c
 LOCAL_LDFLAGS   :=
 
 include $(BUILD_EXECUTABLE)
+
+
+# benchmarks, not part of the app. "ndk-build BENCH=1" builds them from the
+# same sources and flags as simplesshd-jni, to be run from adb shell. See
+# dropbear/bench.h
+
+ifeq ($(BENCH),1)
+define bench-executable
+include $$(CLEAR_VARS)
+
+LOCAL_CFLAGS    := $$(DROPBEAR_CFLAGS)
+LOCAL_MODULE    := $(1)
+
+LOCAL_SRC_FILES := interface.c $$(DROPBEAR_SRCS) \
+	$$(DROPBEAR_PATH)/bench-harness.c \
+	$$(DROPBEAR_PATH)/$(1).c
+LOCAL_C_INCLUDES:= dropbear dropbear/libtomcrypt/src/headers dropbear/libtommath
+LOCAL_LDLIBS    := -lz
+
+include $$(BUILD_EXECUTABLE)
+endef
+
+BENCH_EXECUTABLES := bench-mac bench-ecc bench-math
+$(foreach b,$(BENCH_EXECUTABLES),$(eval $(call bench-executable,$(b))))
+endif
@@ -22,6 +22,10 @@
 #define HAVE_BASENAME 1
 #define HAVE_NETINET_TCP_H 1
 #define HAVE_LIBGEN_H 1
+#define HAVE_SYS_UIO_H 1
+#define HAVE_SYS_EPOLL_H 1
+/* lets write_packet() send many queued packets per syscall */
+#define HAVE_WRITEV 1
 #define USE_DEV_PTMX 1
 
 #undef DISABLE_ZLIB
@@ -34,8 +38,9 @@
 
 #define LOCALOPTIONS_H_EXISTS 1
 
-/* this makes dropbear much faster at receiving files */
-#define DEFAULT_RECV_WINDOW (512*1024)
+/* this makes dropbear much faster at receiving files. Channels only
+ * grow their window this far when they need to */
+#define DEFAULT_RECV_WINDOW (2*1024*1024)
 #define RECV_MAX_PAYLOAD_LEN (128*1024)
 
 /* in jni/interface.c: */